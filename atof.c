@@ -35,6 +35,7 @@
 	3v0 1/2/2020 - added floating point version strtof().	
 	3v1 2/2/2020 - version of strtof() that uses u32 as much as possible. It was not possible to only use u32, so swaps to u64 for mantissa if lots of digits given.
 	3.2 3/2/2020 - autoselection of fastest version of strtof() depending upon use of x64 or x32 compilation.
+	3.3 2022 - added fast_strtof_batch() and fast_strtod_batch() which convert an array of numbers, several at a time in interleaved "lanes".
 				  
  */   
 
@@ -91,6 +92,8 @@ double fast_atof(const char *s,bool * not_number);
 double fast_atof_nan(const char *s);// like fast_atof, but returns NAN if whole string is not a valid number
 double fast_strtod(const char *s,char ** endptr);
 float fast_strtof(const char *s,char **endptr); // if endptr != NULL returns 1st character thats not in the number
+void fast_strtof_batch(const char *const *s,size_t n,float *v,char **endptrs); // v[i]=fast_strtof(s[i],&endptrs[i]) for i=0..n-1, but faster
+void fast_strtod_batch(const char *const *s,size_t n,double *v,char **endptrs); // v[i]=fast_strtod(s[i],&endptrs[i]) for i=0..n-1, but faster
    					
 static const int maxExponent = 308;	/* Largest possible base 10 for a double exponent. (must match array below) */
 static const int maxfExponent = 38;	/* Largest possible base 10 for a float exponent. (must match array below) */
@@ -338,6 +341,7 @@ static uint32_t u32powersOf10[]=
  if(endptr!=NULL) *endptr=(char *)se; // we now know the end of the number - so save it now (means we can have multiple returns going forward without having to worry about this)	
  if(expsign) rexp=-rexp;	
  rexp+=exp; // add in correct to exponent from mantissa processing
+ if(r==0) rexp=0; // zero is zero whatever the exponent (otherwise eg 0e99 would overflow to INFINITY)
 #if 1 /* if 0 removes the optimisations which just results in slower code - there is no loss of accuracy with these optimisations */
  if(rexp>0 && rexp+nos_mant_digits<=maxdigits)
  	{// optimisation: can do all calculations using uint64 which is fastish and exact
@@ -367,6 +371,7 @@ static uint32_t u32powersOf10[]=
 	 	{
  		 rexp=maxExponent;
  		 exp-=maxExponent; // any excess which we will also need to divide by (if its > 0)
+ 		 if(exp>maxExponent) exp=maxExponent; // the result is 0 anyway, this just keeps the index inside the table (for very large negative exponents)
  		}
  	  else exp=0;	
  	  dr=r/powersOf10[rexp]; // negative exponent means we divide by powers of 10
@@ -564,6 +569,7 @@ float fast_strtof(const char *s,char **endptr) // if endptr != NULL returns 1st
  if(endptr!=NULL) *endptr=(char *)se; // we now know the end of the number - so save it now (means we can have multiple returns going forward without having to worry about this)	
  if(expsign) rexp=-rexp;	
  rexp+=exp; // add in correct to exponent from mantissa processing
+ if(r==0) rexp=0; // zero is zero whatever the exponent (otherwise eg 0e99 would overflow to INFINITY)
 #if 1 /* if 0 removes the optimisations which just results in slower code - there is no loss of accuracy with these optimisations */
  if(rexp>0 && rexp+nos_mant_digits<=9)
  	{// optimisation: can do all calculations using uint32 which is exact and fast
@@ -595,6 +601,7 @@ float fast_strtof(const char *s,char **endptr) // if endptr != NULL returns 1st
 	 	{
  		 rexp=maxfExponent;
  		 exp-=maxfExponent; // any excess which we will also need to divide by (if its > 0)
+ 		 if(exp>maxfExponent) exp=maxfExponent; // the result is 0 anyway, this just keeps the index inside the table (for very large negative exponents)
  		}
  	  else exp=0;	
  	  dr=(double)r/dblpowersOf10[rexp]; // negative exponent means we divide by powers of 10
@@ -751,6 +758,7 @@ float fast_strtof(const char *s,char **endptr) // if endptr != NULL returns 1st
  if(endptr!=NULL) *endptr=(char *)se; // we now know the end of the number - so save it now (means we can have multiple returns going forward without having to worry about this)	
  if(expsign) rexp=-rexp;	
  rexp+=exp; // add in correct to exponent from mantissa processing
+ if(r64==0) rexp=0; // zero is zero whatever the exponent (otherwise eg 0e99 would overflow to INFINITY)
 #if 1 /* if 0 removes the optimisations which just results in slower code - there is no loss of accuracy with these optimisations */
  if(!usingr64 && rexp>0 && rexp+nos_mant_digits<=9)
  	{// optimisation: can do all calculations using uint32 which is exact and fast
@@ -783,6 +791,7 @@ float fast_strtof(const char *s,char **endptr) // if endptr != NULL returns 1st
 	 	{
  		 rexp=maxfExponent;
  		 exp-=maxfExponent; // any excess which we will also need to divide by (if its > 0)
+ 		 if(exp>maxfExponent) exp=maxfExponent; // the result is 0 anyway, this just keeps the index inside the table (for very large negative exponents)
  		}
  	  else exp=0;	
  	  if(!usingr64) dr=(double)r32/dblpowersOf10[rexp]; // negative exponent means we divide by powers of 10
@@ -812,5 +821,122 @@ float fast_strtof(const char *s,char **endptr) // if endptr != NULL returns 1st
 #endif 
  return (float)dr;
 }
-#endif 
- 
+#endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * void fast_strtof_batch(const char *const *s,size_t n,float *v,char **endptrs)
+ * void fast_strtod_batch(const char *const *s,size_t n,double *v,char **endptrs)
+ *
+ *	Convert the n numbers starting at s[0..n-1], giving exactly the same results as calling fast_strtof() / fast_strtod() for each one.
+ *  Most numbers being sorted are just [-]digits[.digits] , BATCH_LANES of these are scanned with a simple loop, then converted together,
+ *  so the cpu can overlap the conversions (and the lookups in the tables of powers of 10) of several numbers.
+ *  The tests for NAN, INF, whitespace, + signs and exponents are then only needed for a lane that stops on one of these, which is then converted
+ *  by fast_strtof() / fast_strtod(), as are numbers with too many digits for the simple conversions below.
+ *  Stepping the digit loops of all the lanes together was tried, but was slower as the lanes are rarely the same length.
+ * Results:
+ *	v[i] is the number at the start of s[i], endptrs[i] is set to the first character thats not in the number (s[i] if there is no number).
+ *
+ * If endptrs == NULL it is ignored.
+ *
+ *----------------------------------------------------------------------
+ */
+#define BATCH_LANES 4 /* numbers scanned together */
+#if defined(__SIZEOF_POINTER__ ) && __SIZEOF_POINTER__ == 8
+ #define BATCH_FLT_DIGITS 6 /* must match the float only optimisation in the version of fast_strtof() used */
+#else
+ #define BATCH_FLT_DIGITS 7
+#endif
+
+struct _lanes /* numbers being scanned by batch_scan() */
+	{const char *p[BATCH_LANES]; // end of the number
+	 uint64_t r[BATCH_LANES]; // mantissa (all the digits, ignoring the decimal point)
+	 int nd[BATCH_LANES]; // number of significant digits in r (digits after leading zeros)
+	 int nf[BATCH_LANES]; // number of digits after the decimal point
+	 bool sign[BATCH_LANES]; // true if negative
+	 bool simple[BATCH_LANES]; // true if the number is just [-]digits[.digits] (with at least one digit)
+	};
+
+static void batch_scan(const char *const *s,struct _lanes *b) /* scan the numbers at s[0..BATCH_LANES-1] */
+{const char *p,*q;
+ uint64_t r;
+ unsigned int d;
+ int l,ni,nd;
+ for(l=0;l<BATCH_LANES;++l)
+ 	{b->sign[l]= *s[l]=='-';
+ 	 p=q=s[l]+b->sign[l];
+ 	 r=0;
+ 	 nd=0;
+ 	 while((d=(unsigned int)((unsigned char)*p-'0'))<10)
+ 	 	{r=r*10+d; // may overflow with lots of digits, but then nd is too big to use r
+ 	 	 nd+= r!=0;
+ 	 	 ++p;
+ 	 	}
+ 	 ni=(int)(p-q);
+ 	 if(*p=='.') ++p;
+ 	 q=p;
+ 	 while((d=(unsigned int)((unsigned char)*p-'0'))<10)
+ 	 	{r=r*10+d;
+ 	 	 nd+= r!=0;
+ 	 	 ++p;
+ 	 	}
+ 	 b->p[l]=p;
+ 	 b->r[l]=r;
+ 	 b->nd[l]=nd;
+ 	 b->nf[l]=(int)(p-q);
+ 	 b->simple[l]= ni+b->nf[l]>0 && *p!='e' && *p!='E';
+ 	}
+}
+
+void fast_strtof_batch(const char *const *s,size_t n,float *v,char **endptrs)
+{struct _lanes b;
+ size_t i;
+ int l;
+ float f;
+ for(i=0;i+BATCH_LANES<=n;i+=BATCH_LANES)
+ 	{batch_scan(s+i,&b);
+ 	 for(l=0;l<BATCH_LANES;++l)
+ 	 	{if(!b.simple[l] || b.nd[l]>maxfdigits || b.nf[l]>maxfExponent)
+ 	 	 	{v[i+l]=fast_strtof(s[i+l],endptrs==NULL ? NULL : &endptrs[i+l]);
+ 	 	 	 continue;
+ 	 	 	}
+ 	 	 // the same calculations as fast_strtof(), so the results are identical
+ 	 	 if(b.nf[l]==0)
+ 	 	 	f=(float)b.r[l];
+ 	 	 else if(b.nf[l]<=BATCH_FLT_DIGITS && b.nd[l]<=BATCH_FLT_DIGITS)
+ 	 	 	f=(float)b.r[l]/fltpowersOf10[b.nf[l]];
+ 	 	 else
+ 	 	 	f=(float)((double)b.r[l]/dblpowersOf10[b.nf[l]]);
+ 	 	 v[i+l]= b.sign[l] ? -f : f;
+ 	 	 if(endptrs!=NULL) endptrs[i+l]=(char *)b.p[l];
+ 	 	}
+ 	}
+ for(;i<n;++i)
+ 	v[i]=fast_strtof(s[i],endptrs==NULL ? NULL : &endptrs[i]);
+}
+
+void fast_strtod_batch(const char *const *s,size_t n,double *v,char **endptrs)
+{struct _lanes b;
+ size_t i;
+ int l;
+ double f;
+ for(i=0;i+BATCH_LANES<=n;i+=BATCH_LANES)
+ 	{batch_scan(s+i,&b);
+ 	 for(l=0;l<BATCH_LANES;++l)
+ 	 	{if(!b.simple[l] || b.nd[l]>15 || b.nf[l]>15)
+ 	 	 	{v[i+l]=fast_strtod(s[i+l],endptrs==NULL ? NULL : &endptrs[i+l]);
+ 	 	 	 continue;
+ 	 	 	}
+ 	 	 // the same calculations as fast_strtod(), so the results are identical
+ 	 	 if(b.nf[l]==0)
+ 	 	 	f=(double)b.r[l];
+ 	 	 else
+ 	 	 	f=b.r[l]/dblpowersOf10[b.nf[l]];
+ 	 	 v[i+l]= b.sign[l] ? -f : f;
+ 	 	 if(endptrs!=NULL) endptrs[i+l]=(char *)b.p[l];
+ 	 	}
+ 	}
+ for(;i<n;++i)
+ 	v[i]=fast_strtod(s[i],endptrs==NULL ? NULL : &endptrs[i]);
+}
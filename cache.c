@@ -0,0 +1,266 @@
+/* cache.c
+   =======
+   cache of sorted outputs (nsort --cache-dir DIR), so sorting the same input with the same options again just copies the saved output rather than sorting.
+   Each file in the cache is named from a 128 bit hash of the input (2 independent 64 bit hashes, worked out a line at a time as the input is read so no extra pass is needed),
+   the number of bytes hashed, and a hash of a string describing the options that change the output. The hash reads 8 bytes at a time with a multiply and rotate for each,
+   so it runs at close to memory speed - much less time than the sort it can save. It is not a cryptographic hash, so it should not be used where the input could be chosen to collide.
+   A new file is written to a temporary name then renamed, so other copies of nsort never see a partly written file. Files are marked as used (by setting their modification time)
+   when they are read, and after a file is added the least recently used files are deleted until the total size is within the limit (--cache-max SIZE).
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#ifndef _WIN32
+ #define _POSIX_C_SOURCE 200809L /* for opendir(), getpid() etc with -std=c99 */
+ #include <unistd.h> /* for getpid() */
+ #include <dirent.h> /* for opendir() */
+ #include <utime.h> /* for utime() */
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> /* to print uint64_t */
+#include <time.h>
+#include <sys/stat.h>
+#include "cache.h"
+#ifdef _WIN32
+ #include <windows.h> /* for FindFirstFile() */
+ #include <process.h> /* for _getpid() */
+ #include <sys/utime.h> /* for _utime() */
+ #define getpid _getpid
+ #define utime _utime
+#endif
+
+#define CACHE_COPY_SIZE 65536 /* size of buffer used by cache_copy() */
+#define CACHE_PREFIX "nsort-" /* all cache files start with this */
+#define CACHE_SUFFIX ".out" /* and end with this */
+
+static const uint64_t P1=UINT64_C(0x9E3779B185EBCA87),P2=UINT64_C(0xC2B2AE3D27D4EB4F),P3=UINT64_C(0x165667B19E3779F9); /* odd constants from xxhash */
+
+static inline uint64_t rotl64(uint64_t x,int r)
+{return (x<<r) | (x>>(64-r));
+}
+
+static inline void hash_word(struct cache_hash *h,uint64_t w) /* add 8 bytes to both hashes */
+{h->h[0]=rotl64(h->h[0]^(w*P2),31)*P1;
+ h->h[1]=rotl64(h->h[1]^(w*P3),27)*P2;
+}
+
+static uint64_t fmix64(uint64_t h) /* final mix so every bit of the hash depends on every bit of the input (from xxhash) */
+{h^=h>>33;
+ h*=P2;
+ h^=h>>29;
+ h*=P3;
+ h^=h>>32;
+ return h;
+}
+
+void cache_hash_init(struct cache_hash *h)
+{h->h[0]=P1;
+ h->h[1]=P3;
+ h->bytes=0;
+}
+
+/* cache_hash_add: add s[0..len-1] to the hash */
+void cache_hash_add(struct cache_hash *h,const char *s,size_t len)
+{uint64_t w;
+ size_t i;
+ for(i=0;i+8<=len;i+=8)
+ 	{memcpy(&w,s+i,8); // memcpy() is optimised to a single (unaligned) load
+ 	 hash_word(h,w);
+ 	}
+ w=0;
+ memcpy(&w,s+i,len-i); // last 0..7 bytes
+ hash_word(h,w);
+ hash_word(h,(uint64_t)len); // so where one call ends and the next starts changes the hash
+ h->bytes+=len;
+}
+
+/* cache_path: returns the name of the cache file in dir for the input hashed in h sorted with options */
+char *cache_path(const char *dir,const struct cache_hash *h,const char *options)
+{struct cache_hash opt;
+ size_t n=strlen(dir)+80;
+ char *path=malloc(n);
+ if(path==NULL) return NULL;
+ cache_hash_init(&opt);
+ cache_hash_add(&opt,options,strlen(options));
+ snprintf(path,n,"%s/" CACHE_PREFIX "%016" PRIx64 "%016" PRIx64 "-%" PRIx64 "-%08" PRIx64 CACHE_SUFFIX,dir,fmix64(h->h[0]),fmix64(h->h[1]),h->bytes,fmix64(opt.h[0]) & UINT64_C(0xffffffff));
+ return path;
+}
+
+/* cache_open: returns path opened for reading, or NULL if its not in the cache. Its modification time is set to now so it is the last to be deleted by cache_commit() */
+FILE *cache_open(const char *path)
+{FILE *fp=fopen(path,"r");
+ if(fp!=NULL)
+ 	utime(path,NULL);
+ return fp;
+}
+
+/* cache_copy: copy the rest of from to to */
+bool cache_copy(FILE *from,FILE *to)
+{char *buf=malloc(CACHE_COPY_SIZE);
+ size_t len;
+ bool ok=true;
+ if(buf==NULL) return false;
+ while((len=fread(buf,1,CACHE_COPY_SIZE,from))>0)
+ 	if(fwrite(buf,1,len,to)!=len) ok=false;
+ if(ferror(from)) ok=false;
+ free(buf);
+ return ok;
+}
+
+static char *temp_path(const char *path) /* name of the temporary file that becomes path, includes the process id so 2 copies of nsort writing the same file at once do not clash */
+{size_t n=strlen(path)+32;
+ char *tmp=malloc(n);
+ if(tmp!=NULL)
+ 	snprintf(tmp,n,"%s.%lu.tmp",path,(unsigned long)getpid());
+ return tmp;
+}
+
+/* cache_create: create the temporary file for path, which cache_commit() renames to path */
+/* like stdout this is a text file, and cache_open() opens it as one, so on Windows the \r\n line endings are handled the same way as for stdout */
+FILE *cache_create(const char *path)
+{char *tmp=temp_path(path);
+ FILE *fp;
+ if(tmp==NULL) return NULL;
+ fp=fopen(tmp,"w");
+ free(tmp);
+ return fp;
+}
+
+struct _cachefile /* a file in the cache, found by cache_trim() */
+	{char *name;
+	 uint64_t size;
+	 time_t used; // modification time, set when the file was last read
+	};
+
+static int cmp_used(const void *a,const void *b) /* qsort() compare for cache_trim(), least recently used first */
+{const struct _cachefile *fa=a,*fb=b;
+ return fa->used<fb->used ? -1 : fa->used>fb->used ? 1 : 0;
+}
+
+static bool add_file(struct _cachefile **files,size_t *n,size_t *size,const char *dir,const char *name,uint64_t bytes,time_t used) /* add a file to the list for cache_trim() */
+{struct _cachefile *f;
+ size_t len=strlen(dir)+strlen(name)+2;
+ if(*n>=*size)
+ 	{*size= *size==0 ? 64 : 2 * *size;
+ 	 if((f=realloc(*files,*size*sizeof(struct _cachefile)))==NULL) return false;
+ 	 *files=f;
+ 	}
+ f= &(*files)[*n];
+ if((f->name=malloc(len))==NULL) return false;
+ snprintf(f->name,len,"%s/%s",dir,name);
+ f->size=bytes;
+ f->used=used;
+ ++*n;
+ return true;
+}
+
+/* cache_trim: delete the least recently used files in the cache directory (the one path is in) until the total size is at most max_bytes, path itself is kept even if it is bigger than max_bytes */
+static void cache_trim(const char *path,uint64_t max_bytes)
+{struct _cachefile *files=NULL;
+ size_t n=0,size=0,i;
+ uint64_t total=0;
+ char *dir=malloc(strlen(path)+1),*p;
+ if(dir==NULL) return;
+ strcpy(dir,path);
+ if((p=strrchr(dir,'/'))!=NULL) *p='\0'; // cache_path() always puts a / before the name
+#ifdef _WIN32
+ {WIN32_FIND_DATAA fd;
+  HANDLE h;
+  char *pattern=malloc(strlen(dir)+32);
+  if(pattern!=NULL)
+  	{sprintf(pattern,"%s/" CACHE_PREFIX "*" CACHE_SUFFIX,dir);
+  	 if((h=FindFirstFileA(pattern,&fd))!=INVALID_HANDLE_VALUE)
+  	 	{do
+  	 		{uint64_t bytes=((uint64_t)fd.nFileSizeHigh<<32) | fd.nFileSizeLow;
+  	 		 uint64_t t=((uint64_t)fd.ftLastWriteTime.dwHighDateTime<<32) | fd.ftLastWriteTime.dwLowDateTime;
+  	 		 if(!add_file(&files,&n,&size,dir,fd.cFileName,bytes,(time_t)(t/10000000))) break; // FILETIME is in 100ns units
+  	 		 total+=bytes;
+  	 		} while(FindNextFileA(h,&fd));
+  	 	 FindClose(h);
+  	 	}
+  	 free(pattern);
+  	}
+ }
+#else
+ {DIR *d=opendir(dir);
+  struct dirent *e;
+  struct stat st;
+  size_t len;
+  char *name=NULL;
+  if(d!=NULL)
+  	{while((e=readdir(d))!=NULL)
+  		{len=strlen(e->d_name);
+  		 if(strncmp(e->d_name,CACHE_PREFIX,strlen(CACHE_PREFIX))!=0 || len<strlen(CACHE_SUFFIX) || strcmp(e->d_name+len-strlen(CACHE_SUFFIX),CACHE_SUFFIX)!=0)
+  		 	continue; // not a cache file (temporary files end in .tmp)
+  		 if((p=realloc(name,strlen(dir)+len+2))==NULL) break;
+  		 name=p;
+  		 sprintf(name,"%s/%s",dir,e->d_name);
+  		 if(stat(name,&st)!=0) continue; // may have just been deleted by another copy of nsort
+  		 if(!add_file(&files,&n,&size,dir,e->d_name,(uint64_t)st.st_size,st.st_mtime)) break;
+  		 total+=(uint64_t)st.st_size;
+  		}
+  	 closedir(d);
+  	}
+  free(name);
+ }
+#endif
+ if(total>max_bytes)
+ 	{qsort(files,n,sizeof(struct _cachefile),cmp_used);
+ 	 for(i=0;i<n && total>max_bytes;++i)
+ 	 	if(strcmp(files[i].name,path)!=0 && remove(files[i].name)==0) // never delete the file just added (the times are only to the nearest second)
+ 	 		total-=files[i].size;
+ 	}
+ for(i=0;i<n;++i)
+ 	free(files[i].name);
+ free(files);
+ free(dir);
+}
+
+/* cache_commit: close fp and rename it to path, then trim the cache to max_bytes */
+/* returns false (and deletes the temporary file) if it could not be written or renamed */
+bool cache_commit(FILE *fp,const char *path,uint64_t max_bytes)
+{char *tmp=temp_path(path);
+ bool ok= !ferror(fp);
+ if(fclose(fp)!=0) ok=false;
+ if(tmp==NULL) return false;
+ if(ok && rename(tmp,path)!=0)
+ 	{remove(path); // on Windows rename() fails if path exists (eg another copy of nsort has just written it)
+ 	 ok= rename(tmp,path)==0;
+ 	}
+ if(!ok) remove(tmp);
+ free(tmp);
+ if(ok) cache_trim(path,max_bytes);
+ return ok;
+}
+
+/* cache_discard: close fp and delete it rather than adding it to the cache (eg a worker failed so the output is not complete) */
+void cache_discard(FILE *fp,const char *path)
+{char *tmp=temp_path(path);
+ fclose(fp);
+ if(tmp==NULL) return;
+ remove(tmp);
+ free(tmp);
+}
@@ -0,0 +1,28 @@
+/* cache.h */
+/* cache of sorted outputs in a directory, keyed by a hash of the input and the sort options - see cache.c */
+#ifndef __CACHE_H
+ #define __CACHE_H
+ #include <stdio.h> /* for FILE */
+ #include <stdint.h> /* for uint64_t */
+ #include <stddef.h> /* for size_t */
+ #include <stdbool.h> /* for bool */
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	struct cache_hash /* hash of the input so far, set by cache_hash_init() then cache_hash_add() */
+		{uint64_t h[2]; // 2 independent 64 bit hashes
+		 uint64_t bytes; // number of bytes hashed
+		};
+
+	void cache_hash_init(struct cache_hash *h);
+	void cache_hash_add(struct cache_hash *h,const char *s,size_t len); // add s[0..len-1] to the hash, for lines each call is one line (so "ab","c" is different to "a","bc")
+	char *cache_path(const char *dir,const struct cache_hash *h,const char *options); // name of the cache file in dir for this input and options (a string that describes all the options that change the output), returns NULL if no memory. free() this when finished with
+	FILE *cache_open(const char *path); // open the cache file path for reading (and mark it as recently used), returns NULL if it is not in the cache
+	bool cache_copy(FILE *from,FILE *to); // copy the rest of from to to, returns false on error
+	FILE *cache_create(const char *path); // create a temporary file to be written then added to the cache as path by cache_commit(), returns NULL if it cannot be created
+	bool cache_commit(FILE *fp,const char *path,uint64_t max_bytes); // fclose() fp (from cache_create() ) and make it the cache file path, then delete the least recently used files until the cache is at most max_bytes. Returns false if fp could not be added
+	void cache_discard(FILE *fp,const char *path); // fclose() fp (from cache_create() ) and delete it, for when the output could not all be written
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
@@ -0,0 +1,183 @@
+/* csv.c
+   =====
+   RFC 4180 aware splitting of a buffer holding a csv file into records, and location of fields within a record.
+
+   In a csv file fields may be enclosed in double quotes, and a quoted field may contain commas, newlines and double quotes (which are written as "").
+   This means a record ends at a newline that is not inside double quotes, so a record may span several lines.
+
+   csv_split() finds the record boundaries 64 characters at a time by creating bitmasks of the positions of double quotes and newlines
+   (using SSE2/AVX2 instructions when the compiler supports them), then uses a prefix xor of the quote bitmask to find which characters are inside quotes.
+   This is the approach used by simdcsv ( https://github.com/geofflangdale/simdcsv ), it avoids a test and branch per character and so runs close to memory bandwidth.
+   Note that "" (an escaped double quote) toggles the "inside quotes" state twice so needs no special treatment.
+   For nsort -c --field N, csv_key_offsets() then stores the offset of field N in front of each record, so a comparison finds it with csv_key() rather than scanning the record again.
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdbool.h> /* for bool */
+#include <stdint.h>  /* for uint64_t etc */
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+ #include <immintrin.h> /* for SSE2/AVX2 intrinsics */
+#endif
+#include "csv.h"
+
+#if defined __GNUC__
+static inline int ctz64(uint64_t x) { return __builtin_ctzll(x); } /* number of trailing zero bits, x must not be 0 */
+#else // version in standard C , this is slower than above optimised version but portable
+static inline int ctz64(uint64_t x)
+{int i=0;
+ while(!(x&1))
+ 	{x>>=1;
+ 	 ++i;
+ 	}
+ return i;
+}
+#endif
+
+/* return a bitmask with bit i set if p[i]==c for i=0..63 */
+static inline uint64_t block_mask(const char *p,char c)
+{
+#if defined(__AVX2__)
+ const __m256i vc=_mm256_set1_epi8(c);
+ uint64_t lo=(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p),vc));
+ uint64_t hi=(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p+32)),vc));
+ return lo | (hi<<32);
+#elif defined(__SSE2__)
+ const __m128i vc=_mm_set1_epi8(c);
+ uint64_t m0=(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p),vc));
+ uint64_t m1=(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+16)),vc));
+ uint64_t m2=(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+32)),vc));
+ uint64_t m3=(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+48)),vc));
+ return m0 | (m1<<16) | (m2<<32) | (m3<<48);
+#else
+ uint64_t m=0;
+ int i;
+ for(i=0;i<64;++i)
+ 	m|=(uint64_t)(p[i]==c)<<i;
+ return m;
+#endif
+}
+
+/* prefix xor - bit i of the result is the xor of bits 0..i of x. Applied to the quote bitmask this gives a mask of the characters inside quotes (including the opening quote) */
+static inline uint64_t prefix_xor(uint64_t x)
+{x^=x<<1;
+ x^=x<<2;
+ x^=x<<4;
+ x^=x<<8;
+ x^=x<<16;
+ x^=x<<32;
+ return x;
+}
+
+/* csv_split: split buf[0..len-1] into records at newlines that are not inside double quotes.
+   The newline at the end of each record is replaced by '\0' and store() is called with a pointer to the start of the record.
+   If the last record has no trailing newline then buf[len] must be '\0' (so the caller needs to allocate len+1 bytes) - it is then stored as well.
+   returns 0 if OK, -1 if store() fails (store() should return <0 on failure).
+*/
+int csv_split(char *buf,size_t len,int (*store)(char *record))
+{char *rec=buf; /* start of current record */
+ uint64_t inquote=0; /* all 1's if the previous block ended inside quotes, otherwise 0 */
+ size_t i=0;
+ for(i=0;i+64<=len;i+=64)
+ 	{char *p=buf+i;
+ 	 uint64_t nl=block_mask(p,'\n');
+ 	 uint64_t q=block_mask(p,'"');
+ 	 if(q!=0 || inquote)
+ 	 	{uint64_t inside=prefix_xor(q)^inquote;
+ 	 	 nl&= ~inside; /* newlines inside quotes do not end a record */
+ 	 	 inquote= (uint64_t)0-(inside>>63); /* all 1's if still inside quotes at the end of this block */
+ 	 	}
+ 	 while(nl)
+ 	 	{int b=ctz64(nl);
+ 	 	 p[b]='\0';
+ 	 	 if(store(rec)<0) return -1;
+ 	 	 rec=p+b+1;
+ 	 	 nl&=nl-1; /* clear lowest set bit */
+ 	 	}
+ 	}
+ /* process any remaining characters (<64) one at a time */
+ for(;i<len;++i)
+ 	{if(buf[i]=='"') inquote= ~inquote;
+ 	 else if(buf[i]=='\n' && !inquote)
+ 	 	{buf[i]='\0';
+ 	 	 if(store(rec)<0) return -1;
+ 	 	 rec=buf+i+1;
+ 	 	}
+ 	}
+ if(rec<buf+len)
+ 	{/* last record did not end with a newline */
+ 	 buf[len]='\0';
+ 	 if(store(rec)<0) return -1;
+ 	}
+ return 0;
+}
+
+/* csv_field_end: return a pointer to the character that terminates the field starting at field (a ',' or the '\0' at the end of the record)
+   if quoted is true then commas inside double quotes are part of the field (as in a csv file) */
+char *csv_field_end(const char *field,bool quoted)
+{bool inquote=false;
+ if(!quoted)
+ 	return (char *)field+strcspn(field,",");
+ for(;*field;++field)
+ 	{if(*field=='"') inquote= !inquote;
+ 	 else if(*field==',' && !inquote) break;
+ 	}
+ return (char *)field;
+}
+
+/* csv_field: return a pointer to the start of field number "field" of record (1 is the 1st field).
+   Fields are separated by commas, if quoted is true then commas inside double quotes do not separate fields (as in a csv file).
+   returns NULL if the record has less than field fields.
+*/
+char *csv_field(const char *record,unsigned int field,bool quoted)
+{while(field>1)
+ 	{record=csv_field_end(record,quoted);
+ 	 if(*record=='\0') return NULL; // not enough fields
+ 	 ++record; // skip ','
+ 	 --field;
+ 	}
+ return (char *)record;
+}
+
+/* csv_key_offsets: store the offset of field number "field" in front of each record, so it can be found by csv_key() without scanning the record from its start (and keeping track of quotes)
+   each time it is needed (eg for every comparison of nsort -c --field N).
+   records[0..n-1] are the records found by csv_split() in increasing order of address, and there must be space for n*CSV_KEY_SIZE more characters after the end of the last record.
+   Each record is moved up to make space for its offset (starting with the last, so records not yet moved are never overwritten) and records[] is updated.
+   A record with less than field fields gets the offset of its terminating '\0', so its key is an empty string. */
+void csv_key_offsets(char **records,size_t n,unsigned int field,bool quoted)
+{size_t i,len,off;
+ char *dst,*f;
+ for(i=n;i-->0;)
+ 	{len=strlen(records[i])+1;
+ 	 dst=records[i]+(i+1)*CSV_KEY_SIZE; // record i-1 ends before records[i] so its offset at dst-CSV_KEY_SIZE fits before this record once all the records before it have been moved
+ 	 memmove(dst,records[i],len);
+ 	 f=csv_field(dst,field,quoted);
+ 	 off= f==NULL ? len-1 : (size_t)(f-dst);
+ 	 memcpy(dst-CSV_KEY_SIZE,&off,CSV_KEY_SIZE);
+ 	 records[i]=dst;
+ 	}
+}
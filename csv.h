@@ -0,0 +1,24 @@
+/* csv.h */
+/* RFC 4180 aware splitting of a buffer into records, and location of fields within a record - see csv.c */
+#ifndef __CSV_H
+ #define __CSV_H
+ #include <stddef.h> /* for size_t */
+ #include <stdbool.h> /* for bool */
+ #include <string.h> /* for memcpy() */
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	int csv_split(char *buf,size_t len,int (*store)(char *record)); // split buf into records at newlines that are not inside double quotes. returns 0 if OK, -1 if store() fails
+	char *csv_field(const char *record,unsigned int field,bool quoted); // return pointer to start of field (1 is the 1st field) or NULL if there are not enough fields
+	char *csv_field_end(const char *field,bool quoted); // return pointer to the character that terminates the field that starts at field (',' or '\0')
+	#define CSV_KEY_SIZE sizeof(size_t) /* space used in front of each record by csv_key_offsets() */
+	void csv_key_offsets(char **records,size_t n,unsigned int field,bool quoted); // store the offset of field in front of each of records[0..n-1] (from csv_split() , which must have space for n*CSV_KEY_SIZE more characters after its end) moving the records up to make space
+	static inline const char *csv_key(const char *record) // return the field whose offset csv_key_offsets() stored in front of record
+		{size_t off;
+		 memcpy(&off,record-CSV_KEY_SIZE,CSV_KEY_SIZE);
+		 return record+off;
+		}
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
@@ -0,0 +1,160 @@
+/* decnum.c
+   ========
+   exact comparison of decimal numbers (--exact), without converting them to floats or doubles.
+
+   A number (an optional sign, digits, and an optional decimal point followed by more digits) is described once by a struct decnum:
+   where its integer digits start after any leading zeros and how many there are, and where its fraction digits start and how many there are once trailing zeros are removed.
+   Two positive numbers are then compared by the number of integer digits (more digits is bigger), then memcmp() of the integer digits, then memcmp() of the fraction digits.
+   This is exact however many digits the numbers have, so long numbers that round to the same double are never seen as equal, and it is fast for integers of different lengths.
+   As for GNU sort -n exponents (eg 1e5) are not part of a number. Text that is not a number sorts before all numbers, as it does for numcmp().
+
+   decnum_key() gives a 32 bit key in the same order as decnum_cmp() (but numbers that only differ after their first 6 significant digits can have the same key),
+   so lines can be radix sorted on these keys (see keysort.c) and only lines with the same key need decnum_cmp().
+   decnum_cmp_diff() compares the difference of 2 numbers with a third exactly (for --window-key D with --exact).
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "decnum.h"
+
+#define DEC_KEY_DIGITS 6 /* number of significant digits in the key from decnum_key() , 10^6 needs 20 bits */
+#define DEC_KEY_EXP 64 /* exponents (position of the 1st significant digit) from -DEC_KEY_EXP+1 to DEC_KEY_EXP-2 have their own keys */
+
+/* decnum_parse: set *d to describe the number at the start of s (any leading whitespace or quotes should already have been skipped) */
+void decnum_parse(struct decnum *d,const char *s)
+{const char *p;
+ int sign=1;
+ if(*s=='-' || *s=='+')
+ 	{if(*s=='-') sign= -1;
+ 	 ++s;
+ 	}
+ if(!((*s>='0' && *s<='9') || (*s=='.' && s[1]>='0' && s[1]<='9')))
+ 	{d->sign=DECNUM_NAN; // not a number
+ 	 d->ip=d->fp=s;
+ 	 d->nint=d->nfrac=0;
+ 	 return;
+ 	}
+ while(*s=='0') ++s; // skip leading zeros
+ for(p=s;*p>='0' && *p<='9';++p);
+ d->ip=s;
+ d->nint=(uint32_t)(p-s);
+ if(*p=='.')
+ 	{s=++p;
+ 	 while(*p>='0' && *p<='9') ++p;
+ 	 while(p>s && p[-1]=='0') --p; // ignore trailing zeros
+ 	}
+ else
+ 	s=p;
+ d->fp=s;
+ d->nfrac=(uint32_t)(p-s);
+ d->sign= (d->nint==0 && d->nfrac==0) ? 0 : sign; // -0 and 0.000 are the same as 0
+}
+
+/* magcmp: compare the magnitudes of a and b (which are both non-zero numbers), returns <0 , 0 or >0 */
+static int magcmp(const struct decnum *a,const struct decnum *b)
+{uint32_t m;
+ int r;
+ if(a->nint!=b->nint)
+ 	return a->nint<b->nint ? -1 : 1; // more integer digits (with no leading zeros) is bigger
+ if((r=memcmp(a->ip,b->ip,a->nint))!=0)
+ 	return r;
+ m= a->nfrac<b->nfrac ? a->nfrac : b->nfrac;
+ if((r=memcmp(a->fp,b->fp,m))!=0)
+ 	return r;
+ return (a->nfrac>m) - (b->nfrac>m); // the longer fraction has a non-zero digit after the shorter one ends
+}
+
+/* decnum_cmp: compare the numbers described by a and b exactly, returns <0 if a<b , 0 if a==b and >0 if a>b . Things that are not numbers are less than all numbers (and equal to each other) */
+int decnum_cmp(const struct decnum *a,const struct decnum *b)
+{if(a->sign!=b->sign)
+ 	return a->sign<b->sign ? -1 : 1;
+ if(a->sign==0 || a->sign==DECNUM_NAN)
+ 	return 0;
+ return a->sign>0 ? magcmp(a,b) : magcmp(b,a);
+}
+
+static inline int digit_at(const struct decnum *d,int pos) /* digit of |d| at pos, where pos>=0 is the units (0), tens (1) ... and pos<0 is the fraction digits (-1 is tenths) */
+{if(pos>=0)
+ 	return (uint32_t)pos<d->nint ? d->ip[d->nint-1-(uint32_t)pos]-'0' : 0;
+ return (uint32_t)(-pos)<=d->nfrac ? d->fp[-pos-1]-'0' : 0;
+}
+
+/* decnum_cmp_diff: compare b-a with d exactly (eg for nsort --window-key D with --exact), returns <0 if b-a<d , 0 if b-a==d and >0 if b-a>d . Things that are not numbers are taken as 0 */
+/* b-a-d is worked out a digit at a time (from the least significant digit) with a carry that can be negative, so no buffer is needed however many digits the numbers have */
+int decnum_cmp_diff(const struct decnum *a,const struct decnum *b,const struct decnum *d)
+{int pos,lo,hi,v,carry=0,sa,sb,sd;
+ bool nonzero=false;
+ sa= a->sign==DECNUM_NAN ? 0 : a->sign;
+ sb= b->sign==DECNUM_NAN ? 0 : b->sign;
+ sd= d->sign==DECNUM_NAN ? 0 : d->sign;
+ lo= -(int)(a->nfrac>b->nfrac ? (a->nfrac>d->nfrac ? a->nfrac : d->nfrac) : (b->nfrac>d->nfrac ? b->nfrac : d->nfrac));
+ hi= (int)(a->nint>b->nint ? (a->nint>d->nint ? a->nint : d->nint) : (b->nint>d->nint ? b->nint : d->nint));
+ for(pos=lo;pos<hi;++pos)
+ 	{v=carry+sb*digit_at(b,pos)-sa*digit_at(a,pos)-sd*digit_at(d,pos); // -19..18 (as the carry is -2..1)
+ 	 carry= v>=0 ? v/10 : -((9-v)/10); // floor(v/10)
+ 	 v-=10*carry; // 0..9
+ 	 if(v!=0) nonzero=true;
+ 	}
+ /* b-a-d is carry*10^hi plus the digits (which are >=0 and <10^hi) */
+ if(carry!=0) return carry<0 ? -1 : 1;
+ return nonzero ? 1 : 0;
+}
+
+/* decnum_key: return a 32 bit key for d, keys of different numbers are in the same order as decnum_cmp() , or equal */
+uint32_t decnum_key(const struct decnum *d)
+{const char *s;
+ uint32_t n,i,digits=0,m;
+ int e;
+ if(d->sign==DECNUM_NAN) return 0;
+ if(d->sign==0) return UINT32_C(0x80000000);
+ /* e is the position of the 1st significant digit: nint for numbers >=1 , and minus the number of leading zeros in the fraction for numbers <1 */
+ if(d->nint>0)
+ 	{e= d->nint<DEC_KEY_EXP ? (int)d->nint : DEC_KEY_EXP;
+ 	 s=d->ip;
+ 	 n=d->nint;
+ 	}
+ else
+ 	{s=d->fp;
+ 	 while(*s=='0') ++s; // skip leading zeros of the fraction
+ 	 e= -(int)(s-d->fp);
+ 	 n=d->nfrac-(uint32_t)(s-d->fp);
+ 	}
+ if(e<= -DEC_KEY_EXP)
+ 	m=0; // very small, all have the same key
+ else if(e>=DEC_KEY_EXP-1)
+ 	m=(uint32_t)(2*DEC_KEY_EXP-1)<<20; // very big, all have the same key (which is bigger than any key below)
+ else
+ 	{for(i=0;i<DEC_KEY_DIGITS;++i) // first DEC_KEY_DIGITS significant digits, which continue into the fraction for numbers >=1
+ 		{digits*=10;
+ 		 if(i<n) digits+=(uint32_t)(s[i]-'0');
+ 		 else if(d->nint>0 && i-n<d->nfrac) digits+=(uint32_t)(d->fp[i-n]-'0');
+ 		}
+ 	 m=((uint32_t)(e+DEC_KEY_EXP)<<20) | digits;
+ 	}
+ return d->sign>0 ? UINT32_C(0x80000001)+m : UINT32_C(0x7fffffff)-m; // negative numbers are in reverse order below zero
+}
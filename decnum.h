@@ -0,0 +1,25 @@
+/* decnum.h */
+/* exact comparison of decimal numbers without converting them to floats - see decnum.c */
+#ifndef __DECNUM_H
+ #define __DECNUM_H
+ #include <stdint.h> /* for uint32_t */
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	#define DECNUM_NAN (-2) /* sign of something that is not a number (it sorts before all numbers) */
+	struct decnum /* a decimal number, as set by decnum_parse() */
+		{const char *ip; // integer digits, after any leading zeros
+		 const char *fp; // fraction digits (after the decimal point)
+		 uint32_t nint; // number of integer digits (0 if the number is less than 1)
+		 uint32_t nfrac; // number of fraction digits, not counting trailing zeros
+		 int sign; // 1 , -1 , 0 for zero or DECNUM_NAN
+		};
+
+	void decnum_parse(struct decnum *d,const char *s); // describe the number at the start of s (so it is not converted to binary), leading whitespace must already be skipped
+	int decnum_cmp(const struct decnum *a,const struct decnum *b); // compare exactly, returns <0 , 0 or >0
+	int decnum_cmp_diff(const struct decnum *a,const struct decnum *b,const struct decnum *d); // compare b-a with d exactly, returns <0 , 0 or >0
+	uint32_t decnum_key(const struct decnum *d); // 32 bit key in the same order as decnum_cmp(), but different numbers may have the same key
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
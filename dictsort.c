@@ -0,0 +1,175 @@
+/* dictsort.c
+   ==========
+   string sort for lines where the field being sorted on has only a few different values (eg a region, status or hostname among millions of lines).
+
+   A hash table is used to build a dictionary of the different keys. The dictionary is sorted once, and each line is then given the rank of its key in the sorted dictionary.
+   The lines are then sorted on these (small) integer ranks using radix_sort_items() from keysort.c, which for less than 2048 keys only needs one (counting sort) pass.
+   Only lines that have the same key then need to be compared as strings (and only if there is something after the key on the line).
+
+   The key is the field being sorted on, together with the character that ends it (',' or the '\0' at the end of the line).
+   Including this character means no key can be the start of a different key, so sorting keys with memcmp() gives the same order as comparing the lines with strcmp() from the start of the field,
+   which means the result is identical to a sort with mysCompare().
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h> /* for bool */
+#include <string.h>
+#include "dictsort.h"
+#include "keysort.h"
+#include "csv.h"
+#include "qsort.h"
+
+struct dict_entry
+	{const char *key; // key (points into a line)
+	 size_t len; // length of key, including the ',' or '\0' that ends it
+	 uint64_t hash;
+	};
+
+static unsigned int nkeys=0; // number of different keys found by the last call to dict_sort()
+
+unsigned int dict_keys(void)
+{return nkeys;
+}
+
+static inline uint64_t hash_key(const char *s,size_t len) /* FNV-1a hash */
+{uint64_t h=UINT64_C(14695981039346656037);
+ while(len--)
+ 	{h^=(unsigned char)*s++;
+ 	 h*=UINT64_C(1099511628211);
+ 	}
+ return h;
+}
+
+static int entryCompare(const void *a,const void *b) /* compare dictionary entries for qsort() */
+{const struct dict_entry *ea=a,*eb=b;
+ int r=memcmp(ea->key,eb->key,ea->len<eb->len ? ea->len : eb->len);
+ if(r!=0) return r;
+ return ea->len<eb->len ? -1 : (ea->len>eb->len); // cannot actually happen for different keys as no key is the start of another key
+}
+
+static char **tie_lines; // lines being sorted, used by tieCompare()
+static unsigned int tie_field; // field being sorted on
+static bool tie_quoted;
+
+static int tieCompare(const void *a,const void *b) /* compare lines with the same key as strings (from the start of the key) for qsort() */
+{const char *pa=csv_field(tie_lines[KITEM_LINE(*(const kitem_t *)a)],tie_field,tie_quoted);
+ const char *pb=csv_field(tie_lines[KITEM_LINE(*(const kitem_t *)b)],tie_field,tie_quoted);
+ return strcmp(pa==NULL ? "" : pa,pb==NULL ? "" : pb);
+}
+
+/* dict_sort: sort lines[0..n-1] as strings from the start of field (1 is the start of the line), if quoted is true fields can be in double quotes as in a csv file.
+   returns 0 if the lines have been sorted,
+           1 if there are more than max_keys different keys (in which case lines[] is unchanged and another sort should be used)
+          -1 if there was not enough memory (lines[] is unchanged)
+*/
+int dict_sort(char **lines,unsigned int n,unsigned int field,bool quoted,unsigned int max_keys)
+{struct dict_entry *dict=NULL;
+ uint32_t *table=NULL; // hash table, holds dictionary index+1 (0 means unused)
+ uint32_t *rank=NULL; // rank[dictionary index] = position of key in the sorted dictionary
+ bool *has_tail=NULL; // has_tail[rank] is true if the key ends with ',' so lines with this key need to be compared as strings
+ kitem_t *items=NULL;
+ char **sorted=NULL;
+ size_t tsize,mask;
+ unsigned int i,j,k;
+ int result= -1;
+ nkeys=0;
+ if(max_keys<1) max_keys=1;
+ for(tsize=1;tsize<2*(size_t)max_keys;tsize<<=1); // table is at most half full
+ mask=tsize-1;
+ dict=malloc(max_keys*sizeof(struct dict_entry));
+ table=calloc(tsize,sizeof(uint32_t));
+ items=malloc(n*sizeof(kitem_t)+1);
+ if(dict==NULL || table==NULL || items==NULL)
+ 	goto done;
+ for(i=0;i<n;++i)
+ 	{const char *key=csv_field(lines[i],field,quoted);
+ 	 size_t len,h;
+ 	 uint64_t hash;
+ 	 if(key==NULL) key=""; // not enough fields, treated as an empty field
+ 	 len=csv_field_end(key,quoted)-key+1; // +1 to include the ',' or '\0' that ends the field
+ 	 hash=hash_key(key,len);
+ 	 for(h=hash&mask;table[h]!=0;h=(h+1)&mask) // linear probing
+ 	 	{struct dict_entry *e=&dict[table[h]-1];
+ 	 	 if(e->hash==hash && e->len==len && memcmp(e->key,key,len)==0)
+ 	 	 	break; // found key
+ 	 	}
+ 	 if(table[h]==0)
+ 	 	{// new key
+ 	 	 if(nkeys>=max_keys)
+ 	 	 	{result=1; // too many keys
+ 	 	 	 goto done;
+ 	 	 	}
+ 	 	 dict[nkeys].key=key;
+ 	 	 dict[nkeys].len=len;
+ 	 	 dict[nkeys].hash=hash;
+ 	 	 table[h]= ++nkeys;
+ 	 	}
+ 	 items[i]=KITEM(table[h]-1,i); // dictionary index for now, changed to rank below
+ 	}
+ free(table);
+ table=NULL;
+ /* sort the dictionary, keeping track of where each entry moved to */
+ rank=malloc(nkeys*sizeof(uint32_t));
+ has_tail=malloc(nkeys*sizeof(bool));
+ sorted=malloc(n*sizeof(char *)+1);
+ if(rank==NULL || has_tail==NULL || sorted==NULL)
+ 	goto done;
+ for(k=0;k<nkeys;++k)
+ 	dict[k].hash=k; // hash no longer needed, use it to hold the original dictionary index
+ qsort(dict,nkeys,sizeof(struct dict_entry),entryCompare);
+ for(k=0;k<nkeys;++k)
+ 	{rank[dict[k].hash]=k;
+ 	 has_tail[k]= dict[k].key[dict[k].len-1]!='\0';
+ 	}
+ for(i=0;i<n;++i)
+ 	items[i]=KITEM(rank[KITEM_KEY(items[i])],i);
+ if(radix_sort_items(items,n)<0)
+ 	goto done;
+ /* lines with the same key may still need to be sorted as strings */
+ tie_lines=lines;
+ tie_field=field;
+ tie_quoted=quoted;
+ for(i=0;i<n;i=j)
+ 	{k=KITEM_KEY(items[i]);
+ 	 for(j=i+1;j<n && KITEM_KEY(items[j])==k;++j); // find end of run with the same key
+ 	 if(j-i>1 && has_tail[k])
+ 	 	qsort(items+i,j-i,sizeof(kitem_t),tieCompare);
+ 	}
+ for(i=0;i<n;++i)
+ 	sorted[i]=lines[KITEM_LINE(items[i])];
+ memcpy(lines,sorted,n*sizeof(char *));
+ result=0;
+done:
+ free(dict);
+ free(table);
+ free(rank);
+ free(has_tail);
+ free(items);
+ free(sorted);
+ return result;
+}
@@ -0,0 +1,14 @@
+/* dictsort.h */
+/* string sort using an order preserving dictionary of the (few) different keys - see dictsort.c */
+#ifndef __DICTSORT_H
+ #define __DICTSORT_H
+ #include <stdbool.h> /* for bool */
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	int dict_sort(char **lines,unsigned int n,unsigned int field,bool quoted,unsigned int max_keys); // returns 0 if sorted, 1 if more than max_keys different keys (lines unchanged), -1 if no memory
+	unsigned int dict_keys(void); // number of different keys found by the last call to dict_sort()
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
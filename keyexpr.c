@@ -0,0 +1,292 @@
+/* keyexpr.c
+   =========
+   arithmetic expressions on the fields of a line, used to calculate a numeric sort key for each line (--key-expr).
+
+   An expression can use:
+   	c1, c2, ...       the number in field 1, 2, ... of the line (fields are separated by commas)
+   	numbers           eg 2, 1.5e3
+   	+ - * /           with the usual precedence, and unary -
+   	( )
+   	abs(x) min(x,y) max(x,y)
+   for example "c2+c3" , "abs(c4)" or "c5/c2".
+
+   The expression is compiled once (by a recursive descent parser) into bytecode for a simple stack machine, which is then run for each line by keyexpr_eval().
+   The fields used by the expression are found with a single scan of the line, and converted to numbers with fast_strtod().
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdbool.h> /* for bool */
+#include <ctype.h>
+#include <limits.h>
+#include "keyexpr.h"
+#include "csv.h"
+
+double fast_strtod(const char *s,char ** endptr);// like strtod() but faster (in atof.c)
+
+#define MAX_CODE 256 /* max number of bytecode instructions in an expression */
+#define MAX_STACK 32 /* max depth of the stack needed to evaluate an expression */
+#define MAX_FIELDS 32 /* max number of different fields an expression can use */
+#define MAX_NESTING 256 /* max nesting of unary operators, brackets and function calls (limits recursion in the parser) */
+
+enum op {OP_CONST,OP_FIELD,OP_ADD,OP_SUB,OP_MUL,OP_DIV,OP_NEG,OP_ABS,OP_MIN,OP_MAX};
+
+struct instr
+	{enum op op;
+	 double v; // value for OP_CONST
+	 int slot; // index into field values for OP_FIELD
+	};
+
+struct keyexpr
+	{struct instr code[MAX_CODE];
+	 int ncode;
+	 unsigned int fields[MAX_FIELDS]; // fields used, in increasing order (1 is the 1st field)
+	 int nfields;
+	};
+
+struct parser /* state used while compiling */
+	{const char *s; // next character to parse
+	 struct keyexpr *e;
+	 int depth,maxdepth; // current and max stack depth
+ int nesting; // current nesting of unary(), (expr) and function calls
+	 const char *err; // set on 1st error
+	};
+
+static bool expr(struct parser *p); // forward reference as expressions are recursive
+
+static void skipspace(struct parser *p)
+{while(isspace((unsigned char)*p->s)) ++p->s;
+}
+
+static bool error(struct parser *p,const char *msg)
+{if(p->err==NULL) p->err=msg;
+ return false;
+}
+
+static bool emit(struct parser *p,enum op op,double v,int slot,int stack_change) // add an instruction, stack_change is its effect on the stack depth
+{struct instr *i;
+ if(p->e->ncode>=MAX_CODE) return error(p,"expression too long");
+ i=&p->e->code[p->e->ncode++];
+ i->op=op;
+ i->v=v;
+ i->slot=slot;
+ p->depth+=stack_change;
+ if(p->depth>p->maxdepth) p->maxdepth=p->depth;
+ if(p->maxdepth>MAX_STACK) return error(p,"expression too complex");
+ return true;
+}
+
+static int field_slot(struct parser *p,unsigned int field) // return slot for field, adding it to the list of fields used if necessary
+{struct keyexpr *e=p->e;
+ int i,j;
+ for(i=0;i<e->nfields && e->fields[i]<field;++i);
+ if(i<e->nfields && e->fields[i]==field) return i; // already used
+ if(e->nfields>=MAX_FIELDS) return -1;
+ for(j=e->nfields;j>i;--j) e->fields[j]=e->fields[j-1]; // keep list sorted
+ e->fields[i]=field;
+ e->nfields++;
+ for(j=0;j<e->ncode;++j) // slots after the one inserted have moved up by 1
+ 	if(e->code[j].op==OP_FIELD && e->code[j].slot>=i) e->code[j].slot++;
+ return i;
+}
+
+static bool primary(struct parser *p) // number, field, function call or (expr)
+{const char *s;
+ char *end;
+ skipspace(p);
+ s=p->s;
+ if(*s=='(')
+ 	{p->s++;
+ 	 if(++p->nesting>MAX_NESTING) return error(p,"expression too complex");
+ 	 if(!expr(p)) return false;
+ 	 p->nesting--;
+ 	 skipspace(p);
+ 	 if(*p->s!=')') return error(p,"missing )");
+ 	 p->s++;
+ 	 return true;
+ 	}
+ if((*s=='c' || *s=='C') && isdigit((unsigned char)s[1]))
+ 	{unsigned long f=strtoul(s+1,&end,10);
+ 	 int slot;
+ 	 if(f<1 || f>UINT_MAX) return error(p,"invalid field number (c1 is the 1st field)");
+ 	 p->s=end;
+ 	 if((slot=field_slot(p,(unsigned int)f))<0) return error(p,"too many fields used");
+ 	 return emit(p,OP_FIELD,0,slot,1);
+ 	}
+ if(isalpha((unsigned char)*s))
+ 	{// function call
+ 	 enum op op;
+ 	 int nargs=1;
+ 	 const char *name=s;
+ 	 while(isalpha((unsigned char)*p->s)) p->s++;
+ 	 if(p->s-name==3 && (name[0]|0x20)=='a' && (name[1]|0x20)=='b' && (name[2]|0x20)=='s') op=OP_ABS;
+ 	 else if(p->s-name==3 && (name[0]|0x20)=='m' && (name[1]|0x20)=='i' && (name[2]|0x20)=='n') {op=OP_MIN; nargs=2;}
+ 	 else if(p->s-name==3 && (name[0]|0x20)=='m' && (name[1]|0x20)=='a' && (name[2]|0x20)=='x') {op=OP_MAX; nargs=2;}
+ 	 else return error(p,"unknown function (abs, min and max are allowed)");
+ 	 skipspace(p);
+ 	 if(*p->s!='(') return error(p,"missing ( after function name");
+ 	 p->s++;
+ 	 if(++p->nesting>MAX_NESTING) return error(p,"expression too complex");
+ 	 if(!expr(p)) return false;
+ 	 if(nargs==2)
+ 	 	{skipspace(p);
+ 	 	 if(*p->s!=',') return error(p,"min() and max() need 2 values");
+ 	 	 p->s++;
+ 	 	 if(!expr(p)) return false;
+ 	 	}
+ 	 p->nesting--;
+ 	 skipspace(p);
+ 	 if(*p->s!=')') return error(p,"missing ) after function arguments");
+ 	 p->s++;
+ 	 return emit(p,op,0,0,1-nargs);
+ 	}
+ if(isdigit((unsigned char)*s) || *s=='.')
+ 	{double v=fast_strtod(s,&end);
+ 	 if(end==s) return error(p,"invalid number");
+ 	 p->s=end;
+ 	 return emit(p,OP_CONST,v,0,1);
+ 	}
+ if(*s=='\0') return error(p,"unexpected end of expression");
+ return error(p,"unexpected character in expression");
+}
+
+static bool unary(struct parser *p) // optional unary + or - followed by a primary
+{bool ok;
+ if(++p->nesting>MAX_NESTING) return error(p,"expression too complex"); // "---...-c1" would otherwise recurse without limit
+ skipspace(p);
+ if(*p->s=='-')
+ 	{p->s++;
+ 	 ok=unary(p) && emit(p,OP_NEG,0,0,0);
+ 	}
+ else if(*p->s=='+')
+ 	{p->s++;
+ 	 ok=unary(p);
+ 	}
+ else ok=primary(p);
+ p->nesting--;
+ return ok;
+}
+
+static bool term(struct parser *p) // unary { (*|/) unary }
+{if(!unary(p)) return false;
+ while(1)
+ 	{skipspace(p);
+ 	 if(*p->s=='*')
+ 	 	{p->s++;
+ 	 	 if(!unary(p) || !emit(p,OP_MUL,0,0,-1)) return false;
+ 	 	}
+ 	 else if(*p->s=='/')
+ 	 	{p->s++;
+ 	 	 if(!unary(p) || !emit(p,OP_DIV,0,0,-1)) return false;
+ 	 	}
+ 	 else return true;
+ 	}
+}
+
+static bool expr(struct parser *p) // term { (+|-) term }
+{if(!term(p)) return false;
+ while(1)
+ 	{skipspace(p);
+ 	 if(*p->s=='+')
+ 	 	{p->s++;
+ 	 	 if(!term(p) || !emit(p,OP_ADD,0,0,-1)) return false;
+ 	 	}
+ 	 else if(*p->s=='-')
+ 	 	{p->s++;
+ 	 	 if(!term(p) || !emit(p,OP_SUB,0,0,-1)) return false;
+ 	 	}
+ 	 else return true;
+ 	}
+}
+
+/* keyexpr_compile: compile expression s into bytecode */
+/* returns NULL on error, in which case *errmsg is set to a description of the problem */
+struct keyexpr *keyexpr_compile(const char *s,const char **errmsg)
+{struct parser p;
+ p.s=s;
+ p.depth=p.maxdepth=0;
+ p.nesting=0;
+ p.err=NULL;
+ if((p.e=calloc(1,sizeof(struct keyexpr)))==NULL)
+ 	{*errmsg="out of memory";
+ 	 return NULL;
+ 	}
+ if(expr(&p))
+ 	{skipspace(&p);
+ 	 if(*p.s!='\0') error(&p,"unexpected character after end of expression");
+ 	}
+ if(p.err!=NULL)
+ 	{*errmsg=p.err;
+ 	 free(p.e);
+ 	 return NULL;
+ 	}
+ return p.e;
+}
+
+void keyexpr_free(struct keyexpr *e)
+{free(e);
+}
+
+/* keyexpr_eval: evaluate e for line, if quoted is true the line is from a csv file so fields may be in double quotes (which can contain commas) */
+/* returns false if a field used by the expression is missing or not a number, otherwise returns true with the value in *result */
+bool keyexpr_eval(const struct keyexpr *e,const char *line,bool quoted,double *result)
+{double fv[MAX_FIELDS]; // values of fields used
+ double stack[MAX_STACK];
+ int sp=0,i;
+ unsigned int field=1; // field line points to
+ char *end;
+ const struct instr *ip,*ipend;
+ for(i=0;i<e->nfields;++i)
+ 	{// fields[] is sorted so we can get all values in one scan of the line
+ 	 const char *s;
+ 	 while(field<e->fields[i])
+ 	 	{line=csv_field_end(line,quoted);
+ 	 	 if(*line=='\0') return false; // not enough fields
+ 	 	 ++line; // skip ','
+ 	 	 ++field;
+ 	 	}
+ 	 s=line;
+ 	 while(isspace((unsigned char)*s)) ++s;
+ 	 if(quoted && *s=='"') ++s;
+ 	 fv[i]=fast_strtod(s,&end);
+ 	 if(end==s) return false; // not a number
+ 	}
+ for(ip=e->code,ipend=e->code+e->ncode;ip<ipend;++ip)
+ 	switch(ip->op)
+ 		{case OP_CONST: stack[sp++]=ip->v; break;
+ 		 case OP_FIELD: stack[sp++]=fv[ip->slot]; break;
+ 		 case OP_ADD: --sp; stack[sp-1]+=stack[sp]; break;
+ 		 case OP_SUB: --sp; stack[sp-1]-=stack[sp]; break;
+ 		 case OP_MUL: --sp; stack[sp-1]*=stack[sp]; break;
+ 		 case OP_DIV: --sp; stack[sp-1]/=stack[sp]; break;
+ 		 case OP_NEG: stack[sp-1]= -stack[sp-1]; break;
+ 		 case OP_ABS: if(stack[sp-1]<0) stack[sp-1]= -stack[sp-1]; break;
+ 		 case OP_MIN: --sp; if(stack[sp]<stack[sp-1]) stack[sp-1]=stack[sp]; break;
+ 		 case OP_MAX: --sp; if(stack[sp]>stack[sp-1]) stack[sp-1]=stack[sp]; break;
+ 		}
+ *result=stack[0];
+ return true;
+}
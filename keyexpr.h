@@ -0,0 +1,16 @@
+/* keyexpr.h */
+/* arithmetic expressions on the fields of a line (eg c2+c3) used as the sort key - see keyexpr.c */
+#ifndef __KEYEXPR_H
+ #define __KEYEXPR_H
+ #include <stdbool.h> /* for bool */
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	struct keyexpr; /* a compiled expression */
+	struct keyexpr *keyexpr_compile(const char *s,const char **errmsg); // compile expression s, returns NULL on error with *errmsg set to a description of the error
+	bool keyexpr_eval(const struct keyexpr *e,const char *line,bool quoted,double *result); // evaluate e for line, returns false if a field used is not a number
+	void keyexpr_free(struct keyexpr *e);
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
@@ -0,0 +1,784 @@
+/* keysort.c
+   =========
+   sorting of lines using numeric keys extracted from the lines.
+
+   Each line to be sorted is represented by a 64 bit "item" holding an order preserving 32 bit key (eg from float_key() ) in its top 32 bits and the line number in its bottom 32 bits.
+   Items are sorted on their keys, and then runs of items with identical keys are sorted using a comparison function on their lines (eg to compare at higher precision, or as strings).
+   This means numbers are only converted once per line (rather than twice for every comparison as qsort() with numcmp() does) and the main sort needs no comparison function.
+
+   radix_sort_items() is a LSD radix sort on the keys (11 bits at a time so 3 passes), passes where all keys have the same digit are skipped.
+   counting_sort_items() is for keys in a small range (eg small integers), it needs just one pass to count the keys and one pass to move the items into place,
+   both of which are split between parallel threads (each thread counts its block of items, so the counts need no locking).
+   quicksort_items() is a dual-pivot quicksort (as V. Yaroslavskiy's for Java 7), which splits the items into 3 parts on each pass so needs fewer passes over memory than a single pivot quicksort.
+   Like local_qsort() in qsort.c it first tries an insertion sort that gives up if more than MAX_INS_MOVES items are out of place (which traps partitions that are already sorted),
+   and swaps to a heapsort if the quicksort is taking too many passes, so it is always O(n*log(n)). As items hold a line number no two items are ever equal, so no special handling of equal keys is needed.
+   Partitions of up to QS_INSERT items are sorted with a bitonic sorting network (using AVX2 instructions if available) rather than an insertion sort, as a network has no data dependent branches.
+   vquicksort_items() is a single pivot quicksort with the same insertion pre-pass, heapsort escape and sorting network, but its partition uses AVX2 instructions to compare 4 items with the pivot at once
+   and permutes them so they can be written to both ends of the array without branches (without AVX2 it is the same as quicksort_items()).
+   flag_sort_items() is an American flag sort, a MSD radix sort on 8 bits at a time that moves items into their buckets in place by following cycles of swaps,
+   so unlike radix_sort_items() it needs no second array of items. Digits that are the same for all the items are skipped, small buckets are sorted with quicksort_items(),
+   and after the first pass the buckets are shared between parallel threads.
+   incremental_sort_items() is the dual-pivot quicksort done smallest part first, so sorted items can be output while the rest are still being sorted (for --incremental).
+   sort_ties_by_value() is for when the 32 bit keys are numbers rounded to floats: only lines whose float keys collide have their full (double) value worked out,
+   which is saved so it is done once per line, then the run is sorted on these values.
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h> /* for bool */
+#include <string.h>
+#include "keysort.h"
+#include "qsort.h"
+#include "threads.h"
+#if defined(__AVX2__)
+ #include <immintrin.h> /* for AVX2 intrinsics */
+#endif
+
+#define RADIX_BITS 11 /* number of bits sorted on in each pass of the radix sort, 11 means the 32 bit keys take 3 passes and the counts (2048*sizeof(size_t)) fit into L1 cache */
+#define RADIX_SIZE (1<<RADIX_BITS)
+#define RADIX_PASSES ((32+RADIX_BITS-1)/RADIX_BITS)
+
+/* radix_sort_items: sort n items into key order. The sort is stable so items with the same key stay in their original (line number) order */
+/* returns 0 if OK, -1 if there was not enough memory (in which case a[] is unchanged) */
+int radix_sort_items(kitem_t *a,size_t n)
+{kitem_t *tmp,*from,*to,*t;
+ size_t (*count)[RADIX_SIZE]; // count[pass][digit]
+ size_t i,sum,c;
+ int pass,shift;
+ if(n<=1) return 0;
+ tmp=malloc(n*sizeof(kitem_t));
+ count=calloc(RADIX_PASSES,sizeof(*count));
+ if(tmp==NULL || count==NULL)
+ 	{free(tmp);
+ 	 free(count);
+ 	 return -1;
+ 	}
+ for(i=0;i<n;++i) // count all passes at once, so we only need to read a[] once
+ 	{uint32_t k=KITEM_KEY(a[i]);
+ 	 for(pass=0;pass<RADIX_PASSES;++pass)
+ 	 	count[pass][(k>>(pass*RADIX_BITS)) & (RADIX_SIZE-1)]++;
+ 	}
+ from=a;
+ to=tmp;
+ for(pass=0;pass<RADIX_PASSES;++pass)
+ 	{shift=32+pass*RADIX_BITS;
+ 	 if(count[pass][(KITEM_KEY(a[0])>>(pass*RADIX_BITS)) & (RADIX_SIZE-1)]==n)
+ 	 	continue; // all keys have the same digit, so this pass would not change anything
+ 	 for(i=0,sum=0;i<RADIX_SIZE;++i) // convert counts into starting positions
+ 	 	{c=count[pass][i];
+ 	 	 count[pass][i]=sum;
+ 	 	 sum+=c;
+ 	 	}
+ 	 for(i=0;i<n;++i)
+ 	 	to[count[pass][(from[i]>>shift) & (RADIX_SIZE-1)]++]=from[i];
+ 	 t=from; // swap buffers for next pass
+ 	 from=to;
+ 	 to=t;
+ 	}
+ if(from!=a)
+ 	memcpy(a,from,n*sizeof(kitem_t)); // result is in tmp, copy back to a
+ free(tmp);
+ free(count);
+ return 0;
+}
+
+#define COUNT_PAR_MIN 100000 /* min number of items worth giving to a thread in counting_sort_items() */
+
+struct _countblock /* a block of items processed by one thread in counting_sort_items() */
+	{const kitem_t *from; // items in this block
+	 size_t n; // number of items in this block
+	 size_t *count; // count[key] for this block, then the position in to[] for the next item with this key
+	 kitem_t *to; // where items are moved to
+	 int phase; // 0 = count keys, 1 = move items
+	};
+
+static void count_block(void *arg) /* do one phase of counting_sort_items() for one block of items, can be run as a thread */
+{struct _countblock *b=arg;
+ size_t i;
+ if(b->phase==0)
+ 	for(i=0;i<b->n;++i)
+ 		b->count[KITEM_KEY(b->from[i])]++;
+ else
+ 	for(i=0;i<b->n;++i)
+ 		b->to[b->count[KITEM_KEY(b->from[i])]++]=b->from[i];
+}
+
+static void run_count_blocks(struct _countblock *blocks,thread_t *th,int nthreads) /* run count_block() for all blocks in parallel */
+{run_blocks(count_block,blocks,sizeof(struct _countblock),nthreads,th,(bool *)(th+nthreads)); // space for started[] is allocated after th[]
+}
+
+/* counting_sort_items: sort n items into key order, all keys must be less than nkeys (which should be small, eg <= COUNT_MAX_KEYS). The sort is stable */
+/* returns 0 if OK, -1 if there was not enough memory (in which case a[] is unchanged) */
+int counting_sort_items(kitem_t *a,size_t n,uint32_t nkeys)
+{kitem_t *tmp;
+ size_t *counts,sum,c;
+ struct _countblock *blocks;
+ thread_t *th;
+ int t,nthreads=threads_for(n,COUNT_PAR_MIN);
+ uint32_t k;
+ if(n<=1) return 0;
+ tmp=malloc(n*sizeof(kitem_t));
+ counts=calloc((size_t)nthreads*nkeys,sizeof(size_t));
+ blocks=calloc(nthreads,sizeof(struct _countblock));
+ th=malloc(nthreads*(sizeof(thread_t)+sizeof(bool)));
+ if(tmp==NULL || counts==NULL || blocks==NULL || th==NULL)
+ 	{free(tmp);
+ 	 free(counts);
+ 	 free(blocks);
+ 	 free(th);
+ 	 return -1;
+ 	}
+ for(t=0;t<nthreads;++t)
+ 	{size_t from=(n*t)/nthreads;
+ 	 blocks[t].from=a+from;
+ 	 blocks[t].n=(n*(t+1))/nthreads-from;
+ 	 blocks[t].count=counts+(size_t)t*nkeys;
+ 	 blocks[t].to=tmp;
+ 	 blocks[t].phase=0;
+ 	}
+ run_count_blocks(blocks,th,nthreads); // count keys in each block
+ for(k=0,sum=0;k<nkeys;++k) // convert counts into starting positions, earlier blocks go first so the sort is stable
+ 	for(t=0;t<nthreads;++t)
+ 		{c=blocks[t].count[k];
+ 		 blocks[t].count[k]=sum;
+ 		 sum+=c;
+ 		}
+ for(t=0;t<nthreads;++t)
+ 	blocks[t].phase=1;
+ run_count_blocks(blocks,th,nthreads); // move items into place
+ memcpy(a,tmp,n*sizeof(kitem_t));
+ free(tmp);
+ free(counts);
+ free(blocks);
+ free(th);
+ return 0;
+}
+
+#define QS_INSERT 64 /* quicksort_items() uses a sorting network for this many items or less (must be <= NET_MAX) */
+#define MAX_INS_MOVES 2 /* max number of items allowed out of place in the insertion sort tried before partitioning (as qsort.c) */
+#define INTROSORT_MULT 3 /* quicksort_items() swaps to a heapsort after INTROSORT_MULT*log2(n) passes (as qsort.c) */
+
+static inline int ilog2_size(size_t x) /* floor(log2(x)) for x>0 */
+{int r=0;
+ while(x>>=1) ++r;
+ return r;
+}
+
+/* try_insertion_items: insertion sort that gives up if more than MAX_INS_MOVES items are out of place. Returns true if a[] is now sorted */
+static bool try_insertion_items(kitem_t *a,size_t n)
+{size_t i,j;
+ int moves=0;
+ kitem_t t;
+ for(i=1;i<n;++i)
+ 	{if(a[i-1]<=a[i]) continue;
+ 	 if(++moves>MAX_INS_MOVES) return false;
+ 	 t=a[i];
+ 	 for(j=i;j>0 && a[j-1]>t;--j)
+ 	 	a[j]=a[j-1];
+ 	 a[j]=t;
+ 	}
+ return true;
+}
+
+static void heapsort_items(kitem_t *a,size_t n) /* heapsort of a[0..n-1] , used if quicksort_items() takes too many passes */
+{size_t i,parent,child;
+ kitem_t t;
+ if(n<2) return;
+ for(i=n/2;i-->0;) // build max heap
+ 	{t=a[i];
+ 	 for(parent=i;(child=2*parent+1)<n;parent=child)
+ 	 	{if(child+1<n && a[child+1]>a[child]) ++child;
+ 	 	 if(a[child]<=t) break;
+ 	 	 a[parent]=a[child];
+ 	 	}
+ 	 a[parent]=t;
+ 	}
+ for(i=n-1;i>0;--i) // move largest to the end, then fix the heap
+ 	{t=a[i];
+ 	 a[i]=a[0];
+ 	 for(parent=0;(child=2*parent+1)<i;parent=child)
+ 	 	{if(child+1<i && a[child+1]>a[child]) ++child;
+ 	 	 if(a[child]<=t) break;
+ 	 	 a[parent]=a[child];
+ 	 	}
+ 	 a[parent]=t;
+ 	}
+}
+
+/* sorting networks for the small partitions left by quicksort_items().
+   The items are copied to a buffer padded to a power of 2 (>=4) with UINT64_MAX, sorted with a bitonic network, then the first n are copied back.
+   The network is the "flip then half-cleaners" form: for each block size k (2,4,..,N) item i of each block is compared with item k-1-i, then with strides k/4,k/8,..,1.
+   Every compare-exchange is branchless, so unlike an insertion sort there are no mispredicted branches. With AVX2 4 items are compared at once
+   (AVX2 only has a signed 64 bit compare, so the top bit is flipped first), otherwise the compiler uses conditional moves. */
+#define NET_MAX 64 /* largest number of items network_items() can sort */
+
+#if defined(__AVX2__)
+static inline void vminmax(__m256i *lo,__m256i *hi) /* *lo=min(*lo,*hi) , *hi=max(*lo,*hi) for 4 unsigned 64 bit items */
+{const __m256i bias=_mm256_set1_epi64x(INT64_MIN);
+ __m256i gt=_mm256_cmpgt_epi64(_mm256_xor_si256(*lo,bias),_mm256_xor_si256(*hi,bias));
+ __m256i mn=_mm256_blendv_epi8(*lo,*hi,gt);
+ *hi=_mm256_blendv_epi8(*hi,*lo,gt);
+ *lo=mn;
+}
+
+/* compare-exchanges between the 4 items in one vector: p is v permuted to give the item each is compared with, mask selects lanes that take the max */
+#define VSTEP(v,perm,mask) do{__m256i p_=_mm256_permute4x64_epi64(v,perm),v_=v; vminmax(&v_,&p_); v=_mm256_blend_epi32(v_,p_,mask);}while(0)
+
+static void network_sort(kitem_t *b,size_t N) /* bitonic sort of b[0..N-1], N a power of 2 >=4 */
+{size_t k,j,i,t;
+ __m256i lo,hi;
+ for(k=2;k<=N;k*=2)
+ 	{if(k<=4)
+ 		{for(i=0;i<N;i+=4) // flip within each vector (then for k==4 stride 1)
+ 			{lo=_mm256_loadu_si256((__m256i *)(b+i));
+ 			 if(k==2) VSTEP(lo,_MM_SHUFFLE(2,3,0,1),0xCC);
+ 			 else
+ 			 	{VSTEP(lo,_MM_SHUFFLE(0,1,2,3),0xF0);
+ 			 	 VSTEP(lo,_MM_SHUFFLE(2,3,0,1),0xCC);
+ 			 	}
+ 			 _mm256_storeu_si256((__m256i *)(b+i),lo);
+ 			}
+ 		}
+ 	 else
+ 	 	{for(i=0;i<N;i+=k) // flip: compare b[i+t] with b[i+k-1-t], so the vector from the top half is reversed
+ 	 		for(t=0;t<k/2;t+=4)
+ 	 			{lo=_mm256_loadu_si256((__m256i *)(b+i+t));
+ 	 			 hi=_mm256_permute4x64_epi64(_mm256_loadu_si256((__m256i *)(b+i+k-4-t)),_MM_SHUFFLE(0,1,2,3));
+ 	 			 vminmax(&lo,&hi);
+ 	 			 _mm256_storeu_si256((__m256i *)(b+i+t),lo);
+ 	 			 _mm256_storeu_si256((__m256i *)(b+i+k-4-t),_mm256_permute4x64_epi64(hi,_MM_SHUFFLE(0,1,2,3)));
+ 	 			}
+ 	 	 for(j=k/4;j>=4;j/=2) // half-cleaners with strides of whole vectors
+ 	 	 	for(i=0;i<N;i+=2*j)
+ 	 	 		for(t=0;t<j;t+=4)
+ 	 	 			{lo=_mm256_loadu_si256((__m256i *)(b+i+t));
+ 	 	 			 hi=_mm256_loadu_si256((__m256i *)(b+i+j+t));
+ 	 	 			 vminmax(&lo,&hi);
+ 	 	 			 _mm256_storeu_si256((__m256i *)(b+i+t),lo);
+ 	 	 			 _mm256_storeu_si256((__m256i *)(b+i+j+t),hi);
+ 	 	 			}
+ 	 	 for(i=0;i<N;i+=4) // strides 2 and 1 within each vector
+ 	 	 	{lo=_mm256_loadu_si256((__m256i *)(b+i));
+ 	 	 	 VSTEP(lo,_MM_SHUFFLE(1,0,3,2),0xF0);
+ 	 	 	 VSTEP(lo,_MM_SHUFFLE(2,3,0,1),0xCC);
+ 	 	 	 _mm256_storeu_si256((__m256i *)(b+i),lo);
+ 	 	 	}
+ 	 	}
+ 	}
+}
+#else
+static inline void cswap(kitem_t *a,kitem_t *b) /* branchless compare-exchange: *a=min(*a,*b) , *b=max(*a,*b) */
+{kitem_t x=*a,y=*b;
+ *a= x<y ? x : y;
+ *b= x<y ? y : x;
+}
+
+static void network_sort(kitem_t *b,size_t N) /* bitonic sort of b[0..N-1], N a power of 2 >=4 */
+{size_t k,j,i,t;
+ for(k=2;k<=N;k*=2)
+ 	{for(i=0;i<N;i+=k) // flip
+ 		for(t=0;t<k/2;++t)
+ 			cswap(b+i+t,b+i+k-1-t);
+ 	 for(j=k/4;j>=1;j/=2) // half-cleaners
+ 	 	for(i=0;i<N;i+=2*j)
+ 	 		for(t=0;t<j;++t)
+ 	 			cswap(b+i+t,b+i+j+t);
+ 	}
+}
+#endif
+
+static void network_items(kitem_t *a,size_t n) /* sort a[0..n-1] (n<=NET_MAX) using a sorting network */
+{kitem_t b[NET_MAX];
+ size_t N=4,i;
+ if(n<2) return;
+ while(N<n) N*=2;
+ memcpy(b,a,n*sizeof(kitem_t));
+ for(i=n;i<N;++i)
+ 	b[i]=UINT64_MAX; // padding sorts to the end
+ network_sort(b,N);
+ memcpy(a,b,n*sizeof(kitem_t));
+}
+
+static void sort_samples(kitem_t *a,size_t n,size_t pos[5]) /* set pos[] to 5 positions spread through a[0..n-1] (n>=7) and sort the items there in place, used to choose pivots */
+{size_t e=n/7,k,m;
+ kitem_t x;
+ for(k=0;k<5;++k)
+ 	pos[k]=n/2-2*e+k*e;
+ for(k=1;k<5;++k)
+ 	{x=a[pos[k]];
+ 	 for(m=k;m>0 && a[pos[m-1]]>x;--m)
+ 	 	a[pos[m]]=a[pos[m-1]];
+ 	 a[pos[m]]=x;
+ 	}
+}
+
+/* dpq_partition: partition a[0..n-1] (n>=7) around 2 pivots, leaving a[0..lt-1] < a[lt] < a[lt+1..gt-1] < a[gt] < a[gt+1..n-1] so the pivots a[lt] and a[gt] are in their final places */
+static inline void dpq_partition(kitem_t *a,size_t n,size_t *plt,size_t *pgt)
+{size_t lt,gt,k,pos[5];
+ kitem_t p,q,x;
+ sort_samples(a,n,pos); // pivots are the 2nd and 4th of the 5 samples
+ p=a[pos[1]];
+ a[pos[1]]=a[0]; // put p in a[0] and q in a[n-1]
+ a[0]=p;
+ q=a[pos[3]];
+ a[pos[3]]=a[n-1];
+ a[n-1]=q;
+ /* partition into a[1..lt-1] < p , a[lt..gt] between p and q, and a[gt+1..n-2] > q */
+ lt=k=1;
+ gt=n-2;
+ while(k<=gt)
+ 	{x=a[k];
+ 	 if(x<p)
+ 	 	{a[k]=a[lt];
+ 	 	 a[lt++]=x;
+ 	 	}
+ 	 else if(x>q)
+ 	 	{while(a[gt]>q && k<gt) --gt;
+ 	 	 a[k]=a[gt];
+ 	 	 a[gt--]=x;
+ 	 	 x=a[k];
+ 	 	 if(x<p)
+ 	 	 	{a[k]=a[lt];
+ 	 	 	 a[lt++]=x;
+ 	 	 	}
+ 	 	}
+ 	 ++k;
+ 	}
+ /* move pivots into their final places */
+ a[0]=a[--lt];
+ a[lt]=p;
+ a[n-1]=a[++gt];
+ a[gt]=q;
+ *plt=lt;
+ *pgt=gt;
+}
+
+static void dpq_sort(kitem_t *a,size_t n,int passes) /* dual-pivot quicksort of a[0..n-1], swaps to heapsort after passes partitions */
+{size_t lt,gt,nl,nm,nr;
+ while(n>QS_INSERT)
+ 	{if(try_insertion_items(a,n))
+ 		return; // already (nearly) sorted
+ 	 if(passes-- <=0)
+ 	 	{heapsort_items(a,n);
+ 	 	 return;
+ 	 	}
+ 	 dpq_partition(a,n,&lt,&gt);
+ 	 nl=lt; // a[0..lt-1]
+ 	 nm=gt-lt-1; // a[lt+1..gt-1]
+ 	 nr=n-gt-1; // a[gt+1..n-1]
+ 	 /* sort the 2 smaller parts recursively, and loop for the largest so the depth of recursion is O(log(n)) */
+ 	 if(nl>=nm && nl>=nr)
+ 	 	{dpq_sort(a+lt+1,nm,passes);
+ 	 	 dpq_sort(a+gt+1,nr,passes);
+ 	 	 n=nl;
+ 	 	}
+ 	 else if(nm>=nr)
+ 	 	{dpq_sort(a,nl,passes);
+ 	 	 dpq_sort(a+gt+1,nr,passes);
+ 	 	 a+=lt+1;
+ 	 	 n=nm;
+ 	 	}
+ 	 else
+ 	 	{dpq_sort(a,nl,passes);
+ 	 	 dpq_sort(a+lt+1,nm,passes);
+ 	 	 a+=gt+1;
+ 	 	 n=nr;
+ 	 	}
+ 	}
+ network_items(a,n);
+}
+
+/* quicksort_items: sort n items into key order using a dual-pivot quicksort. As the line number is part of each item the result is the same as radix_sort_items() */
+/* always returns 0 (it needs no extra memory), so it can be used in place of radix_sort_items() */
+int quicksort_items(kitem_t *a,size_t n)
+{if(n>1)
+ 	dpq_sort(a,n,INTROSORT_MULT*ilog2_size(n));
+ return 0;
+}
+
+#define INC_BLOCK 4096 /* incremental_sort_items() sorts partitions of this many items or less with dpq_sort() in one go */
+#define INC_STACK (2*INTROSORT_MULT*32+2) /* max partitions waiting to be sorted in incremental_sort_items(), each partition pushes 2 and there are at most INTROSORT_MULT*log2(n) partitions on the way to any item (n<2^32) */
+
+/* incremental_sort_items: sort n items into key order (the same result as quicksort_items() ) but smallest first, so the start of a[] can be used before the rest is sorted.
+   The dual-pivot quicksort always carries on with the leftmost part, keeping the other parts on a stack, so when a part is sorted everything up to the start of the next part on the stack
+   is in its final place and emit(done,arg) is called to say a[0..done-1] are sorted. done never decreases, and the last call has done==n.
+   The first call comes after about 1.5*n items have been partitioned rather than after the whole sort, and the total time is about the same as quicksort_items(). */
+void incremental_sort_items(kitem_t *a,size_t n,void (*emit)(size_t done,void *arg),void *arg)
+{struct {size_t from,n; int passes;} stack[INC_STACK]; // parts still to be sorted, the top one is the leftmost
+ int sp=0;
+ size_t total=n,from=0,lt,gt;
+ int passes=INTROSORT_MULT*ilog2_size(n|1);
+ for(;;)
+ 	{while(n>INC_BLOCK) // partition a[from..from+n-1] until its leftmost part is small
+ 		{if(try_insertion_items(a+from,n))
+ 			break; // already (nearly) sorted
+ 		 if(passes-- <=0)
+ 		 	{heapsort_items(a+from,n);
+ 		 	 break;
+ 		 	}
+ 		 dpq_partition(a+from,n,&lt,&gt);
+ 		 stack[sp].from=from+gt+1; // right part is sorted last
+ 		 stack[sp].n=n-gt-1;
+ 		 stack[sp++].passes=passes;
+ 		 stack[sp].from=from+lt+1; // then the middle part
+ 		 stack[sp].n=gt-lt-1;
+ 		 stack[sp++].passes=passes;
+ 		 n=lt; // and the left part now
+ 		}
+ 	 if(n<=INC_BLOCK)
+ 	 	dpq_sort(a+from,n,passes);
+ 	 if(sp==0) break;
+ 	 --sp;
+ 	 from=stack[sp].from;
+ 	 n=stack[sp].n;
+ 	 passes=stack[sp].passes;
+ 	 emit(from,arg); // everything before this part (including the pivots) is sorted
+ 	}
+ emit(total,arg);
+}
+
+/* vectorised quicksort: a single pivot quicksort whose partition compares 4 items with the pivot at once using AVX2 instructions.
+   The 4 items are rearranged with a permutation from a table (indexed by the compare mask) so items <= pivot come first, then the whole vector is stored at both
+   the left and right ends of the unpartitioned part of the array (the stores overlap, but only the wanted items are counted). This is the AVX2 equivalent of the compress stores
+   used by AVX-512 vectorised quicksorts. To make room for the stores the first and last vectors are held in registers until the end, and each new vector is read from the
+   side with the least free space. Without AVX2 vquicksort_items() uses the dual-pivot quicksort above. */
+#if defined(__AVX2__)
+static const int32_t vq_perm[16][8]= /* for a mask with bit j set if item j > pivot: 32 bit indices that move items <= pivot to the front of the vector (in order) and items > pivot to the back */
+{{0,1,2,3,4,5,6,7},
+ {2,3,4,5,6,7,0,1},
+ {0,1,4,5,6,7,2,3},
+ {4,5,6,7,0,1,2,3},
+ {0,1,2,3,6,7,4,5},
+ {2,3,6,7,0,1,4,5},
+ {0,1,6,7,2,3,4,5},
+ {6,7,0,1,2,3,4,5},
+ {0,1,2,3,4,5,6,7},
+ {2,3,4,5,0,1,6,7},
+ {0,1,4,5,2,3,6,7},
+ {4,5,0,1,2,3,6,7},
+ {0,1,2,3,4,5,6,7},
+ {2,3,0,1,4,5,6,7},
+ {0,1,2,3,4,5,6,7},
+ {0,1,2,3,4,5,6,7}};
+
+/* partition_vec: split the 4 items in v about the pivot, storing the items <= pivot at a[l..] and those > pivot so they end at a[r-1]. Returns the number > pivot */
+static inline size_t partition_vec(kitem_t *a,size_t l,size_t r,__m256i v,__m256i bpivot)
+{const __m256i bias=_mm256_set1_epi64x(INT64_MIN);
+ int mask=_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_xor_si256(v,bias),bpivot)));
+ size_t ngt=(size_t)__builtin_popcount(mask);
+ v=_mm256_permutevar8x32_epi32(v,_mm256_loadu_si256((const __m256i *)vq_perm[mask]));
+ _mm256_storeu_si256((__m256i *)(a+l),v);
+ _mm256_storeu_si256((__m256i *)(a+r-4),v);
+ return ngt;
+}
+
+/* partition_items: rearrange a[0..n-1] (n>=8) so items <= pivot come first, returns the number of them */
+static size_t partition_items(kitem_t *a,size_t n,kitem_t pivot)
+{const __m256i bpivot=_mm256_set1_epi64x((int64_t)(pivot^(1ULL<<63))); // pivot with the top bit flipped, for a signed compare
+ size_t left=0,right=n,lstore,rstore,ngt,i;
+ kitem_t t;
+ __m256i vleft,vright,v;
+ for(i=n%4;i>0;--i) // partition items one at a time until the number left is a multiple of 4
+ 	{if(a[left]>pivot)
+ 		{t=a[left];
+ 		 a[left]=a[--right];
+ 		 a[right]=t;
+ 		}
+ 	 else ++left;
+ 	}
+ if(right-left<8)
+ 	{// too few items left to use vectors
+ 	 while(left<right)
+ 		{if(a[left]>pivot)
+ 			{t=a[left];
+ 			 a[left]=a[--right];
+ 			 a[right]=t;
+ 			}
+ 		 else ++left;
+ 		}
+ 	 return left;
+ 	}
+ vleft=_mm256_loadu_si256((const __m256i *)(a+left));
+ vright=_mm256_loadu_si256((const __m256i *)(a+right-4));
+ lstore=left; // items <= pivot are stored at a[lstore..]
+ rstore=right; // items > pivot are stored ending at a[rstore-1]
+ left+=4;
+ right-=4;
+ while(left<right)
+ 	{if(rstore-right<left-lstore)
+ 		{right-=4;
+ 		 v=_mm256_loadu_si256((const __m256i *)(a+right));
+ 		}
+ 	 else
+ 		{v=_mm256_loadu_si256((const __m256i *)(a+left));
+ 		 left+=4;
+ 		}
+ 	 ngt=partition_vec(a,lstore,rstore,v,bpivot);
+ 	 lstore+=4-ngt;
+ 	 rstore-=ngt;
+ 	}
+ ngt=partition_vec(a,lstore,rstore,vleft,bpivot);
+ lstore+=4-ngt;
+ rstore-=ngt;
+ ngt=partition_vec(a,lstore,rstore,vright,bpivot); // here rstore==lstore+4 so both stores are to the same place
+ return lstore+4-ngt;
+}
+
+static void vq_sort(kitem_t *a,size_t n,int passes) /* quicksort of a[0..n-1] using partition_items(), swaps to heapsort after passes partitions */
+{size_t pos[5],m;
+ while(n>QS_INSERT)
+ 	{if(try_insertion_items(a,n))
+ 		return; // already (nearly) sorted
+ 	 if(passes-- <=0)
+ 	 	{heapsort_items(a,n);
+ 	 	 return;
+ 	 	}
+ 	 sort_samples(a,n,pos);
+ 	 m=partition_items(a,n,a[pos[2]]); // pivot is the median of 5, so 2 items are less and 2 are greater and both parts are at least 3 items
+ 	 /* sort the smaller part recursively, and loop for the larger */
+ 	 if(m<n-m)
+ 	 	{vq_sort(a,m,passes);
+ 	 	 a+=m;
+ 	 	 n-=m;
+ 	 	}
+ 	 else
+ 	 	{vq_sort(a+m,n-m,passes);
+ 	 	 n=m;
+ 	 	}
+ 	}
+ network_items(a,n);
+}
+
+#endif
+
+/* vquicksort_items: sort n items into key order using a single pivot quicksort with a vectorised partition. The result is the same as radix_sort_items() */
+/* without AVX2 this is the same as quicksort_items(), as a scalar single pivot partition is slower than the dual-pivot one */
+/* always returns 0 (it needs no extra memory), so it can be used in place of radix_sort_items() */
+int vquicksort_items(kitem_t *a,size_t n)
+{if(n>1)
+#if defined(__AVX2__)
+ 	vq_sort(a,n,INTROSORT_MULT*ilog2_size(n));
+#else
+ 	dpq_sort(a,n,INTROSORT_MULT*ilog2_size(n));
+#endif
+ return 0;
+}
+
+#define FLAG_SMALL 256 /* flag_sort_items() uses quicksort_items() for buckets of this many items or less */
+#define FLAG_PAR_MIN 100000 /* min number of items worth giving to a thread in flag_sort_items() */
+#define FLAG_DIGIT(x,shift) ((unsigned int)((x)>>(shift)) & 0xff)
+
+/* flag_pass: American flag sort pass, moves a[0..n-1] into 256 buckets on the 8 bit digit at shift in place. Returns with end[c] set to the end of bucket c */
+/* each item is swapped directly into the next free place of its bucket, and the item that was there is moved on in the same way, until an item for the current bucket turns up */
+static void flag_pass(kitem_t *a,size_t n,int shift,size_t end[256])
+{size_t head[256],i,k;
+ unsigned int c,d;
+ kitem_t x,t;
+ memset(end,0,256*sizeof(size_t));
+ for(i=0;i<n;++i)
+ 	++end[FLAG_DIGIT(a[i],shift)];
+ for(c=0,k=0;c<256;++c)
+ 	{head[c]=k;
+ 	 k+=end[c];
+ 	 end[c]=k;
+ 	}
+ for(c=0;c<256;++c)
+ 	while(head[c]<end[c])
+ 		{x=a[head[c]];
+ 		 while((d=FLAG_DIGIT(x,shift))!=c)
+ 		 	{t=a[head[d]];
+ 		 	 a[head[d]++]=x;
+ 		 	 x=t;
+ 		 	}
+ 		 a[head[c]++]=x;
+ 		}
+}
+
+/* flag_sort: in place MSD radix sort of a[0..n-1] on bits shift+7 .. 0 of the items (higher bits are the same for all the items) */
+static void flag_sort(kitem_t *a,size_t n,int shift)
+{size_t end[256],start;
+ unsigned int c;
+ for(;;)
+ 	{if(n<=FLAG_SMALL || shift<0)
+ 		{if(shift>=0) quicksort_items(a,n);
+ 		 return;
+ 		}
+ 	 /* skip digits that are the same for all the items (eg the top bits of float keys of numbers of similar size) */
+ 	 c=FLAG_DIGIT(a[0],shift);
+ 	 for(start=1;start<n && FLAG_DIGIT(a[start],shift)==c;++start);
+ 	 if(start<n) break;
+ 	 shift-=8;
+ 	}
+ flag_pass(a,n,shift,end);
+ for(c=0,start=0;c<256;++c)
+ 	{flag_sort(a+start,end[c]-start,shift-8);
+ 	 start=end[c];
+ 	}
+}
+
+struct _flagblock /* buckets sorted by one thread in flag_sort_items() */
+	{kitem_t *a; // all the items
+	 const size_t *end; // bucket c is a[end[c-1]..end[c]-1] (a[0..end[0]-1] for c==0)
+	 int shift; // digit the buckets have been sorted on
+	 bool mine[256]; // buckets sorted by this thread
+	};
+
+static void flag_block(void *arg) /* sort the buckets of one thread in flag_sort_items() */
+{struct _flagblock *b=arg;
+ size_t start;
+ unsigned int c;
+ for(c=0;c<256;++c)
+ 	if(b->mine[c])
+ 		{start= c==0 ? 0 : b->end[c-1];
+ 		 flag_sort(b->a+start,b->end[c]-start,b->shift-8);
+ 		}
+}
+
+/* flag_sort_items: sort n items into key order using an in place MSD radix sort (American flag sort), so it needs no extra memory. The result is the same as radix_sort_items() */
+/* see "Engineering Radix Sort" by P. McIlroy, K. Bostic and M. McIlroy (1993). The first pass is done by this thread, then the 256 buckets are shared between parallel threads */
+/* always returns 0 (if there is not enough memory to run threads the buckets are sorted by this thread), so it can be used in place of radix_sort_items() */
+int flag_sort_items(kitem_t *a,size_t n)
+{size_t end[256],start;
+ struct _flagblock *blocks;
+ thread_t *th;
+ bool *started;
+ int nthreads=threads_for(n,FLAG_PAR_MIN),shift=56,t,owner[256];
+ unsigned int c;
+ if(nthreads<=1)
+ 	{flag_sort(a,n,shift);
+ 	 return 0;
+ 	}
+ blocks=malloc(nthreads*sizeof(struct _flagblock));
+ th=malloc(nthreads*sizeof(thread_t));
+ started=malloc(nthreads*sizeof(bool));
+ if(blocks==NULL || th==NULL || started==NULL)
+ 	{flag_sort(a,n,shift);
+ 	}
+ else
+ 	{while(shift>=0) // find the first digit that is not the same for all the items
+ 		{c=FLAG_DIGIT(a[0],shift);
+ 		 for(start=1;start<n && FLAG_DIGIT(a[start],shift)==c;++start);
+ 		 if(start<n) break;
+ 		 shift-=8;
+ 		}
+ 	 if(shift>=0)
+ 	 	{flag_pass(a,n,shift,end);
+ 	 	 for(t=0;t<nthreads;++t)
+ 	 	 	{blocks[t].a=a;
+ 	 	 	 blocks[t].end=end;
+ 	 	 	 blocks[t].shift=shift;
+ 	 	 	 memset(blocks[t].mine,0,sizeof(blocks[t].mine));
+ 	 	 	}
+ 	 	 share_buckets(end,256,nthreads,owner); // biggest bucket first, each to the thread with least to do so far
+ 	 	 for(c=0;c<256;++c)
+ 	 	 	blocks[owner[c]].mine[c]=true;
+ 	 	 run_blocks(flag_block,blocks,sizeof(struct _flagblock),nthreads,th,started);
+ 	 	}
+ 	}
+ free(blocks);
+ free(th);
+ free(started);
+ return 0;
+}
+
+static int (*tie_cmp)(uint32_t line1,uint32_t line2); // compare function used by sort_ties()
+
+static int tieCompare(const void *a,const void *b) /* compare function for qsort() used by sort_ties() */
+{return tie_cmp(KITEM_LINE(*(const kitem_t *)a),KITEM_LINE(*(const kitem_t *)b));
+}
+
+/* sort_ties: a[] is sorted by key, sort each run of items with the same key using tiecmp() which is given the line numbers to compare */
+/* runs that are already in order (eg where lines with the same key were already sorted in the input) are left as they are */
+void sort_ties(kitem_t *a,size_t n,int (*tiecmp)(uint32_t line1,uint32_t line2))
+{size_t i,j,m;
+ tie_cmp=tiecmp;
+ for(i=0;i<n;i=j)
+ 	{uint32_t k=KITEM_KEY(a[i]);
+ 	 for(j=i+1;j<n && KITEM_KEY(a[j])==k;++j); // find end of run with the same key
+ 	 if(j-i>1)
+ 	 	{m=i+1;
+ 	 	 while(m<j && tiecmp(KITEM_LINE(a[m-1]),KITEM_LINE(a[m]))<=0) ++m; // check if run is already sorted, for random lines this stops very quickly
+ 	 	 if(m<j)
+ 	 	 	qsort(a+i,j-i,sizeof(kitem_t),tieCompare);
+ 	 	}
+ 	}
+}
+
+struct _vtie /* an item and the value of its line, used by sort_ties_by_value() */
+	{double v;
+	 kitem_t item;
+	};
+
+static double (*tie_value)(uint32_t line); // value function used by sort_ties_by_value()
+
+static int vtieCompare(const void *a,const void *b) /* compare function for qsort() used by sort_ties_by_value() */
+{const struct _vtie *x=a,*y=b;
+ if(x->v<y->v) return -1;
+ if(x->v>y->v) return 1;
+ return tie_cmp(KITEM_LINE(x->item),KITEM_LINE(y->item));
+}
+
+static int valueTieCompare(const void *a,const void *b) /* as vtieCompare() but works out the values every time, used if there is not enough memory to save them */
+{uint32_t l1=KITEM_LINE(*(const kitem_t *)a),l2=KITEM_LINE(*(const kitem_t *)b);
+ double v1=tie_value(l1),v2=tie_value(l2);
+ if(v1<v2) return -1;
+ if(v1>v2) return 1;
+ return tie_cmp(l1,l2);
+}
+
+/* sort_ties_by_value: as sort_ties() but runs of items with the same key are sorted on value(line), then using tiecmp() for lines with the same value */
+/* value() is only called for lines whose keys are the same as another line's (eg numbers that are the same when rounded to floats), and only once for each line as the values are saved */
+void sort_ties_by_value(kitem_t *a,size_t n,double (*value)(uint32_t line),int (*tiecmp)(uint32_t line1,uint32_t line2))
+{size_t i,j,m,size=0;
+ struct _vtie *v=NULL,*nv;
+ tie_cmp=tiecmp;
+ tie_value=value;
+ for(i=0;i<n;i=j)
+ 	{uint32_t k=KITEM_KEY(a[i]);
+ 	 for(j=i+1;j<n && KITEM_KEY(a[j])==k;++j); // find end of run with the same key
+ 	 if(j-i<2) continue;
+ 	 if(j-i>size)
+ 	 	{if((nv=realloc(v,(j-i)*sizeof(struct _vtie)))==NULL)
+ 	 		{qsort(a+i,j-i,sizeof(kitem_t),valueTieCompare);
+ 	 		 continue;
+ 	 		}
+ 	 	 v=nv;
+ 	 	 size=j-i;
+ 	 	}
+ 	 for(m=0;m<j-i;++m)
+ 	 	{v[m].item=a[i+m];
+ 	 	 v[m].v=value(KITEM_LINE(a[i+m]));
+ 	 	}
+ 	 for(m=1;m<j-i && vtieCompare(&v[m-1],&v[m])<=0;++m); // check if run is already sorted
+ 	 if(m<j-i)
+ 	 	{qsort(v,j-i,sizeof(struct _vtie),vtieCompare);
+ 	 	 for(m=0;m<j-i;++m)
+ 	 	 	a[i+m]=v[m].item;
+ 	 	}
+ 	}
+ free(v);
+}
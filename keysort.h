@@ -0,0 +1,39 @@
+/* keysort.h */
+/* sorting of lines using numeric keys extracted from the lines - see keysort.c */
+#ifndef __KEYSORT_H
+ #define __KEYSORT_H
+ #include <stddef.h> /* for size_t */
+ #include <stdint.h> /* for uint64_t etc */
+ #include <string.h> /* for memcpy */
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	/* a sort item holds a 32 bit order preserving key in its top 32 bits and the line number in its bottom 32 bits, so sorting items as unsigned integers sorts by key then line number */
+	typedef uint64_t kitem_t;
+	#define KITEM(key,line) (((uint64_t)(key)<<32) | (uint32_t)(line))
+	#define KITEM_KEY(item) ((uint32_t)((item)>>32))
+	#define KITEM_LINE(item) ((uint32_t)(item))
+
+	/* float_key: return a 32 bit unsigned integer that sorts in the same order as float f. -0 is the same as +0 and NAN's sort after +infinity */
+	/* this works on the bits of f as tests like f!=f to find NAN's are optimised away by gcc -Ofast */
+	static inline uint32_t float_key(float f)
+	{uint32_t u;
+	 memcpy(&u,&f,sizeof(u));
+	 if((u & UINT32_C(0x7fffffff)) > UINT32_C(0x7f800000)) u=UINT32_C(0x7fc00000); // all NAN's are the same (+NAN)
+	 else if(u==UINT32_C(0x80000000)) u=0; // -0 => +0
+	 return (u & UINT32_C(0x80000000)) ? ~u : u | UINT32_C(0x80000000); // negative numbers have all bits flipped, positive numbers just have the sign bit flipped
+	}
+
+	int radix_sort_items(kitem_t *a,size_t n); // sort items into key order (stable, so items with the same key stay in line order), returns 0 if OK or -1 if no memory
+	#define COUNT_MAX_KEYS 65536 /* largest number of different keys counting_sort_items() should be used for */
+	int counting_sort_items(kitem_t *a,size_t n,uint32_t nkeys); // as radix_sort_items() but all keys must be less than nkeys, uses parallel threads
+	int quicksort_items(kitem_t *a,size_t n); // as radix_sort_items() but uses a dual-pivot quicksort (so needs no extra memory), always returns 0
+	int vquicksort_items(kitem_t *a,size_t n); // as quicksort_items() but a single pivot quicksort with a partition that uses AVX2 instructions (without AVX2 it is quicksort_items()), always returns 0
+	int flag_sort_items(kitem_t *a,size_t n); // as radix_sort_items() but uses an in place MSD radix sort (American flag sort, so needs no extra memory) with parallel threads, always returns 0
+	void incremental_sort_items(kitem_t *a,size_t n,void (*emit)(size_t done,void *arg),void *arg); // as quicksort_items() but smallest first, calling emit(done,arg) each time a[0..done-1] are sorted (last call has done==n)
+	void sort_ties(kitem_t *a,size_t n,int (*tiecmp)(uint32_t line1,uint32_t line2)); // sort runs of items with the same key using tiecmp() on their line numbers
+	void sort_ties_by_value(kitem_t *a,size_t n,double (*value)(uint32_t line),int (*tiecmp)(uint32_t line1,uint32_t line2)); // as sort_ties() but runs are sorted on value(line) (called once per line in a run) then tiecmp()
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
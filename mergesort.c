@@ -0,0 +1,170 @@
+/* 	mergesort.c
+	===========
+
+  Natural merge sort - finds the runs of elements that are already in order (reversing runs in strictly decreasing order), then merges pairs of adjacent runs until only one is left.
+  This is O(n) for input that is already sorted (or reversed) and O(n*log(r)) for input made up of r runs, so its a lot faster than quicksort for nearly sorted input.
+  Runs shorter than MIN_RUN elements are extended using an insertion sort, so random input is still sorted in O(n*log(n)).
+  The sort is stable. It needs a temporary buffer the same size as the array being sorted.
+
+  Same parameters as mergesort() on BSD systems, returns 0 if OK, or -1 if there is not enough memory for the temporary buffer (in which case the array is unchanged).
+
+  This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef int		 cmp_t(const void *, const void *);
+
+#define MIN_RUN 32 /* runs shorter than this are extended with an insertion sort */
+
+/* we assume pointers have correct alignment for size (es) on call to mergesort, so we can optimise swap and copy for the common sizes (as heapsort.c does) */
+static inline void swapfunc(char *a, char *b, size_t es)
+{
+	if(es==8) /* potential size of pointer (64 bits) or double */
+		{
+		 uint64_t t;
+		 uint64_t *ap=(uint64_t *)a,*bp=(uint64_t *)b;
+		 t = *ap;
+		 *ap = *bp;
+		 *bp = t;
+		}
+	else if(es==4) /* potential size of pointer (32 bits) or float, int etc */
+		{
+		 uint32_t t;
+		 uint32_t *ap=(uint32_t *)a,*bp=(uint32_t *)b;
+		 t = *ap;
+		 *ap = *bp;
+		 *bp = t;
+		}
+	else
+		{ /* general purpose swap for any size - do a byte at a time so can be slow if es is large */
+		 uint8_t t;
+		 do {
+			t = *a;
+			*a++ = *b;
+			*b++ = t;
+	   	 } while (--es > 0);
+	   }
+}
+
+/* Copy one element of size es to another. Again optimised for common sizes */
+static inline void copyfunc(char *to, char *from, size_t es)
+{
+ if(es==8) /* potential size of pointer (64 bits) or double */
+		{*(uint64_t *)to=*(uint64_t *)from;
+		}
+ else if(es==4) /* potential size of pointer (32 bits) or float, int etc */
+		{*(uint32_t *)to=*(uint32_t *)from;
+		}
+ else memcpy(to,from,es); /* general solution */
+}
+
+/* merge the sorted runs a[0..na-1] and b[0..nb-1] into to[] , elements from a are taken first when equal so the merge is stable */
+static void merge(char *to,char *a,size_t na,char *b,size_t nb,size_t es,cmp_t *cmp)
+{char *aend=a+na*es,*bend=b+nb*es;
+ if(cmp(aend-es,b)<=0)
+ 	{// runs are already in order (which is common for nearly sorted input)
+ 	 memcpy(to,a,na*es);
+ 	 memcpy(to+na*es,b,nb*es);
+ 	 return;
+ 	}
+ while(a<aend && b<bend)
+ 	{if(cmp(a,b)<=0)
+ 		{copyfunc(to,a,es);
+ 		 a+=es;
+ 		}
+ 	 else
+ 	 	{copyfunc(to,b,es);
+ 	 	 b+=es;
+ 	 	}
+ 	 to+=es;
+ 	}
+ if(a<aend) memcpy(to,a,aend-a);
+ if(b<bend) memcpy(to,b,bend-b);
+}
+
+int mergesort(void *vbase, size_t n, size_t es, cmp_t *cmp)
+{char *base=vbase,*src,*dst,*t;
+ char *tmp;
+ size_t *runs; // start of each run, runs[nruns]=n
+ size_t nruns=0,i,j,k,end;
+ if(n<=1 || es==0) return 0;
+ tmp=malloc(n*es);
+ runs=malloc((n/MIN_RUN+2)*sizeof(size_t)); // all runs apart from the last one are at least MIN_RUN long
+ if(tmp==NULL || runs==NULL)
+ 	{free(tmp);
+ 	 free(runs);
+ 	 return -1;
+ 	}
+ /* find the runs */
+ for(i=0;i<n;i=j)
+ 	{j=i+1;
+ 	 if(j<n && cmp(base+i*es,base+j*es)>0)
+ 	 	{// strictly decreasing run, find its end then reverse it (strictly so the sort stays stable)
+ 	 	 while(j+1<n && cmp(base+j*es,base+(j+1)*es)>0) ++j;
+ 	 	 for(k=0;i+k<j-k;++k)
+ 	 	 	swapfunc(base+(i+k)*es,base+(j-k)*es,es);
+ 	 	 ++j;
+ 	 	}
+ 	 else
+ 	 	{while(j<n && cmp(base+(j-1)*es,base+j*es)<=0) ++j;
+ 	 	}
+ 	 end= n-i<MIN_RUN ? n : i+MIN_RUN;
+ 	 if(j<end)
+ 	 	{// short run, extend it to MIN_RUN elements with an insertion sort
+ 	 	 char *pm,*pl;
+ 	 	 for(pm=base+j*es;pm<base+end*es;pm+=es)
+ 	 	 	for(pl=pm;pl>base+i*es && cmp(pl-es,pl)>0;pl-=es)
+ 	 	 		swapfunc(pl,pl-es,es);
+ 	 	 j=end;
+ 	 	}
+ 	 runs[nruns++]=i;
+ 	}
+ runs[nruns]=n;
+ /* merge pairs of adjacent runs until only one run is left */
+ src=base;
+ dst=tmp;
+ while(nruns>1)
+ 	{for(k=0;k+1<nruns;k+=2)
+ 		merge(dst+runs[k]*es,src+runs[k]*es,runs[k+1]-runs[k],src+runs[k+1]*es,runs[k+2]-runs[k+1],es,cmp);
+ 	 if(k<nruns) // odd number of runs, last one just needs to be copied
+ 	 	memcpy(dst+runs[k]*es,src+runs[k]*es,(runs[k+1]-runs[k])*es);
+ 	 for(k=0;2*k<nruns;++k) // remove the starts of the runs that have been merged into the run before them
+ 	 	runs[k]=runs[2*k];
+ 	 runs[k]=n;
+ 	 nruns=k;
+ 	 t=src; // swap buffers for next pass
+ 	 src=dst;
+ 	 dst=t;
+ 	}
+ if(src!=base)
+ 	memcpy(base,src,n*es);
+ free(tmp);
+ free(runs);
+ return 0;
+}
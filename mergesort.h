@@ -0,0 +1,12 @@
+/* mergesort.h */
+/* Note this may already be defined in stdlib.h (eg on BSD based systems) so you may not need to include mergesort.h */
+#ifndef __MERGESORT_H
+ #define __MERGESORT_H
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	int mergesort(void *vbase, size_t nmemb, size_t size,int (*compar)(const void *, const void *));// in mergesort.c - natural merge sort, fast for nearly sorted input
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
@@ -1,376 +1,2311 @@
-/* nsort.c 
-   =======
-   loosely based on sort in section 5.11 from K&R "The C programming Language" 2nd edition 
-   
-   sorts stdin and prints result to stdout
-   if "-n" is present does numeric sort on 1st field, otherwise does a string sort
-   if "-q" is present allows numbers inside double quotes and sorts based on the number. -q implies -n .
-   if -n present non-numeric lines will sort first (so a csv files header should stay first)
-   -u only displays unique (different) lines (so deletes duplicates).
-   -h or -? print basic helptext and exit.
-   
-   Has limits on line length and total number of lines as it reads the whole input into RAM before sorting it.
-   
-   sorts into increasing order.
-   
-   This version (c) Peter Miller 2022.
-   Uses (optionally, but by default) fast_atof from https://github.com/p-j-miller/ya-sprintf  and qsort from https://github.com/p-j-miller/yasort-and-yamedian
-   
-   Version 1.0 31/12/2020 - 1st version on github
-   Version 1.1 1/2/2022 - swapped to use qsort.c from yasort-and-yamedian as this is always O(n*log(n)) execution speed and all available processors for sorting which can be a lot faster
-   						- on a 2 processor PC the sort phase was 2.5* faster and the complete time 1.5* faster on the 1M line test file.
-
-*/
-
-/*----------------------------------------------------------------------------
- * Copyright (c) 2020,2022 Peter Miller
- *
- * Permission is hereby granted, free of charge, to any person obtaining
- * a copy of this software and associated documentation files (the
- * "Software"), to deal in the Software without restriction, including
- * without limitation the rights to use, copy, modify, merge, publish,
- * distribute, sublicense, and/or sell copies of the Software, and to
- * permit persons to whom the Software is furnished to do so, subject to
- * the following conditions:
- *
- * The above copyright notice and this permission notice shall be included
- * in all copies or substantial portions of the Software.
- *
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
- * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
- * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
- * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
- * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
- * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
- * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
- *--------------------------------------------------------------------------*/
-/* Define __USE_MINGW_ANSI_STDIO to 1 to use C99 compatible stdio functions on MinGW. see for example https://stackoverflow.com/questions/44382862/how-to-printf-a-size-t-without-warning-in-mingw-w64-gcc-7-1 */
-// #define __USE_MINGW_ANSI_STDIO 1   /* if this is defined then writing to stdout > NUL is VERY slow (70 secs vs 4 secs) ! Note strtof() etc are still much slower than fast_atof() etc */
-/* use mingw64 as compiler - latest TDM-GCC 10.3.0 has __USE_MINGW_ANSI_STDIO set to 1 by default so is very slow writing to NUL: and much slower writing to stdout generally  */
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <stdbool.h> /* for bool */
-#include <ctype.h>
-#include <float.h>
-#include <time.h>
-#include <math.h>
-#include <stdint.h>  /* for int64_t etc */
-#include <inttypes.h> /* to print uint64_t */
-#include "qsort.h" /* qsort.c used */
-
-#define VERSION "1.1" /* using qsort.c rather than libc qsort */
-
-#define USE_FAST_ATOF /* if defined use my fast_atol() from ya-sprintf [which should be much faster] , otherwise use strtod() from the standard library */
-
-#if defined(USE_FAST_ATOF) 
-double fast_atof(const char *string,bool * not_number)	; // converts string to double. Skips leading whitespace. sets not_number true if no number found (and returns 0) otherwise sets it false and returns number read.
-double fast_strtod(const char *s,char ** endptr);// like strtod() but faster
-double fast_atof_nan(const char *s);// like fast_atof, but returns NAN if the string does not start with a valid number
-float fast_strtof(const char *s,char **endptr); // like strtof() but faster
-extern const int fast_strtof_u; // tell rest of system we are using u64's or u32's (only useful for diagnostics/debugging)
-#endif
-
-char *strdup(const char *s); // not in gcc 5.1.0 string.h
-
-#define nsort_num_float /* if defined do numeric sorts with float rather than double */
-
-// following variables used internally by readline():
-static const unsigned int FIRST_SIZE=256; /* initial size of line buffer start at eg 256, size is doubled if its too small */
-static char *buf=NULL; /* input buffer */
-static unsigned int buf_size=0; /* input buffer size, 0 means not yet allocated */
-
-// variables used by readlines (also uses FIRST_SIZE from above)
-static char **lineptr=NULL; /* pointers to lines of text */
-static unsigned int lines_buf_size=0; // current size of lineptr[]
-static unsigned int nlines=0; // nos lines actually in use in lineptr
-
-
-
-bool quoted_numbers=false; /* if true allows numbers with double quotes ("123") to be sorted numerically */
-bool do_uniq=false; /* set to true when -u (unique) option specified on command line */
-bool verbose=false; // set to 1 if -v option present
-
-int readlines(void);
-void writelines(void);
-int numcmp(const char *, const char *);
-
-
- /*  these are the compare routines for qsort() */
-int mysCompare (const void * a, const void * b ) { /* compare as strings */
-    const char *pa = *(const char**)a;
-    const char *pb = *(const char**)b;
-    return strcmp(pa,pb);
-}
-
-int mynCompare (const void * a, const void * b ) { /* compare as numbers */
-    const char *pa = *(const char**)a;
-    const char *pb = *(const char**)b;
-    return numcmp(pa,pb);
-}
-
-
-/* numcmp: compare s1 and s2 numerically */
-/* this version allows numbers in quotes if -q option is specified on command line (quoted_numbers=true) */
-/* also treats non-numbers as very large negative numbers to the sort first [ so a csv file header wil stay at the front of the file ] */
-/* if numbers are identical then sort as strings. This is needed for -u option, but defines order so seens sensible anyway */
-
-int numcmp(const char *s1, const char  *s2)
-{
-#ifdef  nsort_num_float /* if defined do numeric sorts with float rather tha double */	
- float v1,v2;
- char *sret;
-#else
- double v1, v2;
-
-#ifdef USE_FAST_ATOF 	 
- bool not_number;
-#else
-  char *sret;
-#endif   
-#endif 
-  while(isspace(*s1)) ++s1; /* skip initial whitespace */
- if(quoted_numbers && *s1=='"') 
- 	{++s1; // skip " if allowed (no need to worry about trailing " as that will just terminate the number )
- 	}
-#ifdef  nsort_num_float /* if defined do numeric sorts with float rather tha double */	
- #ifdef USE_FAST_ATOF 
- v1=fast_strtof(s1,&sret);
- #else
- v1=strtof(s1,&sret);
- #endif
- if(sret==s1)  v1= -FLT_MAX; // very large negative number if no number found so sorts first	
-#else
-#ifdef USE_FAST_ATOF 	
- v1=fast_atof(s1,&not_number);
- if(not_number) v1= -DBL_MAX; // very large negative number if no number found so sorts first
-#else
- v1=strtod(s1,&sret);
- if(sret==s1)  v1= -DBL_MAX; // very large negative number if no number found so sorts first
-#endif
-#endif 
- while(isspace(*s2)) ++s2; /* skip initial whitespace */
- if(quoted_numbers && *s2=='"') ++s2; // skip " if allowed  
-#ifdef  nsort_num_float /* if defined do numeric sorts with float rather than double */	
- #ifdef USE_FAST_ATOF 
- v2=fast_strtof(s2,&sret);
- #else
- v2=strtof(s2,&sret);
- #endif
- if(sret==s2)  v2= -FLT_MAX; // very large negative number if no number found so sorts first
-#else 
-#ifdef USE_FAST_ATOF  
- v2=fast_atof(s2,&not_number);
- if(not_number) v2= -DBL_MAX; // very large negative number if no number found so sorts first
-#else
- v2=strtod(s2,&sret);
- if(sret==s2)  v2= -DBL_MAX; // very large negative number if no number found so sorts first
-#endif  
-#endif
- if(v1==v2)
- 	return strcmp(s1,s2);	
- if (v1 < v2)
-	return -1;
- else
- 	return 1;	
-}
-
-
-
-/* writelines: write output lines in sorted order */
-/* if -u (unique) option set then only print lines that are different to previous line */
-void writelines(void)
-{
- unsigned int i;
- for (i = 0; i < nlines; i++)
- 	{if(!do_uniq || i==0 ||  strcmp(lineptr[i-1],lineptr[i])) // always print 1st line, or if do_uniq is false. if do_uniq is true and not 1st line print lines that are different
-		printf("%s\n", lineptr[i]);
-	}
-}
-
-
-char *readline (FILE *fp)
-/* read next line from input and return a pointer to it. Returns NULL on EOF or error . Deletes \n from end of line */
-/* the same buffer is reused for the next input */
-/* no limit on the length of the line (except available RAM) */
-{int n;
- char *cp;
- int c=0;
- char *new_buf;
- unsigned int new_size;
- if(buf_size==0)
-        {if((buf=(char *)malloc(FIRST_SIZE))==NULL )
-                return NULL; /* oops no space at all */
-         buf_size=FIRST_SIZE;
-        }
- cp=buf;
- n=buf_size;
- while(1)
-        {while(--n && (c=getc(fp)) != EOF) /* while fits into existing buffer */
-                {if(c=='\n')
-                        {*cp='\0'; /* end of string */
-                         return buf;
-                        }
-                  *cp++=c;
-                 }
-         if(c==EOF)
-                return cp==buf ? NULL : buf; /* if we hit EOF then return last line if any */
-#if 1
-		 new_size= (buf_size | 1023) + 1021; // Increase the size of the buffer a "bit", rounds up to next multiple of 1024 and adds 1020. from an idea at https://stackoverflow.com/questions/43594181/using-parallel-arrays-in-c-to-sort-out-lines-of-data
-#else                
-         new_size=buf_size <<1; /* double size of buffer */
-#endif         
-         if((new_buf=(char *)realloc(buf,new_size))==NULL)
-                {/* realloc failed "eat" rest of line and return truncated line to caller */
-                 while((c=getc(fp)) != EOF && c!= '\n');
-                 *cp='\0';
-                 return buf;
-                }
-           else
-                { /* realloc went OK */
-                 cp=new_buf+(buf_size-1); /* reposition pointer into new buffer */
-                 n=buf_size+1;
-                 buf=new_buf;
-                 buf_size=new_size;
-                }
-        }
-/* NOT REACHED */
-}
-
-/* readlines: read input lines */
-/* returns -1 on error , >=0 if OK */
-/* no limit on the number of lines that can be read (except available RAM). */
-int readlines(void)
-{
- char *p,*l;
- nlines = 0;
- while((l=readline(stdin))!= NULL)
- 	{
-	 if ((p = strdup(l)) == NULL)
-		return -1; // no space for a copy of the line just read in
-	 if(lines_buf_size==0)
-	 	{// need to alocate initial spce for lineptr
-		 lineptr=calloc(FIRST_SIZE,sizeof(char *));
-		 if(lineptr==NULL) 
-		 	return -1; // no space
-		 lines_buf_size=FIRST_SIZE;
-		}
-	 else if(nlines>=lines_buf_size)	
-	 	{// need to increase the space to store lines
-#if 0
-		 lines_buf_size= (lines_buf_size | 1023) + 1021; // Increase the size of the buffer a "bit", rounds up to next multiple of 1024 and adds 1020. from an idea at https://stackoverflow.com/questions/43594181/using-parallel-arrays-in-c-to-sort-out-lines-of-data
-#else  	 	
-	 	 lines_buf_size <<=1 ; // double space
-#endif	 	 
-		 lineptr=realloc(lineptr,lines_buf_size*sizeof(char *));
-		 if(lineptr==NULL) 
-		 	return -1; // no space
-		}
-	 lineptr[nlines++] = p; // store line just read into array
-	}
- return nlines;
-}
-
-
-/* sort input lines */
-int main(int argc, char *argv[])
-{
- bool numeric = false; /* true if numeric sort */
- char c;
- clock_t start_t,end_t; 
- /* based on argument parser from K&R pp 117. allows both nsort -nq and nsort -n -q */
- while(--argc>0 && (*++argv)[0] == '-')
- 	{ while( (c= *++argv[0]) ) /* yes this is an assignment operator !, extra brackets due to gcc warning. */
- 		switch(tolower(c))
- 			{
- 			 case 'n': 	numeric=true;  break;
- 			 case 'q': 	quoted_numbers=true; numeric=true; break; // -q implies -n
- 			 case 'u':  do_uniq=true;  break;
- 			 case 'v':  verbose=true;  break;  
- 			 case '?':  // falls through to 'h' below
- 			 case 'h': 	
-	 					argc= -1; //cause "usage" message then exit
-	 					break;
- 			 default: 	fprintf(stderr,"nsort: invalid option -%c\n",c);
- 				 		argc= -1;
- 				 		break;
- 			}
- 	}
- if(argc>0) // we want 0 as only -xx arguments expected on command line
- 	{fprintf(stderr,"nsort: Invalid argument \"%s\"\n",*argv);
-	 argc= -1; //cause "usage" message then exit
-	} 				
- if(argc<0)
- 	{fprintf(stderr,"nsort version %s created at %s on %s\n sorts stdin to stdout printing the result in increasing order\n",VERSION,__TIME__,__DATE__);
- 	 if(verbose) 
- 		{
-#if defined(USE_FAST_ATOF)  			
- #ifdef nsort_num_float /* if defined do numeric sorts with float rather than double */	 		
-	 	 fprintf(stderr,"Compiled with gcc %s pointer size=%d numeric compare type=float fast_strtof uses u%d\n",__VERSION__,__SIZEOF_POINTER__,fast_strtof_u);
- #else
-	 	 fprintf(stderr,"Compiled with gcc %s pointer size=%d numeric compare type=double fast_strtof uses u%d\n",__VERSION__,__SIZEOF_POINTER__,fast_strtof_u);	 
- #endif
-#else
- #ifdef __USE_MINGW_ANSI_STDIO
-	 	 fprintf(stderr,"Compiled with gcc %s pointer size=%d  __USE_MINGW_ANSI_STDIO defined\n",__VERSION__,__SIZEOF_POINTER__);
- #else
-		 fprintf(stderr,"Compiled with gcc %s pointer size=%d  __USE_MINGW_ANSI_STDIO NOT defined\n",__VERSION__,__SIZEOF_POINTER__);
- #endif	
-#endif 
-		}	
- 	 fprintf(stderr,"Usage: nsort [-nquv?h]\n");
-	 fprintf(stderr,"-n lines are assumed to start with numbers and sorting is done on these.\n");
-	 fprintf(stderr,"   if the numbers are identical the lines are sorted as strings\n");
-	 fprintf(stderr,"-q sort on initial numbers in double quotes (implies -n) \n");
-	 fprintf(stderr,"   otherwise sort lines as strings\n");
-	 fprintf(stderr,"-u only print lines that are unique (ie deletes duplicates)\n");
-	 fprintf(stderr,"-v verbose output (to stderr) - prints execution time etc\n");
-	 fprintf(stderr,"-? or -h prints (this) help message then exists\n");
-	 return 1;
-	} 	
- if(verbose) 
- 	{
-#if defined(USE_FAST_ATOF) 		 		
- #ifdef nsort_num_float /* if defined do numeric sorts with float rather than double */	 		
-	 fprintf(stderr,"nsort version %s compiled with gcc %s pointer size=%d numeric compare type=float fast_strtof uses u%d\n",VERSION,__VERSION__,__SIZEOF_POINTER__,fast_strtof_u);
- #else
-	 fprintf(stderr,"nsort version %s compiled with gcc %s pointer size=%d numeric compare type=double fast_strtof uses u%d\n",VERSION,__VERSION__,__SIZEOF_POINTER__,fast_strtof_u);	 
- #endif	 
-#else
- #ifdef __USE_MINGW_ANSI_STDIO
-	 	 fprintf(stderr,"Compiled with gcc %s pointer size=%d  __USE_MINGW_ANSI_STDIO defined\n",__VERSION__,__SIZEOF_POINTER__);
- #else
-		 fprintf(stderr,"Compiled with gcc %s pointer size=%d  __USE_MINGW_ANSI_STDIO NOT defined\n",__VERSION__,__SIZEOF_POINTER__);
- #endif	
-#endif 
-	}
- /* now do the actual sorting ... */
- start_t=clock();		
- if (readlines() >= 0) {
- 	if(verbose)
- 		{
- 		 end_t=clock();
- 		 fprintf(stderr,"nsort: read in %d lines in %.3f secs\n",nlines,(end_t-start_t)/(double)(CLOCKS_PER_SEC));
- 		 start_t=clock();
- 		}
-    qsort(lineptr,nlines,sizeof(char *),
-    	(int (*)(const void*,const void*))(numeric ? mynCompare : mysCompare)); /* actually do the sort */		
- 	if(verbose)
- 		{
- 		 end_t=clock();
- 		 fprintf(stderr,"nsort: sort took %.3f secs\n",(end_t-start_t)/(double)(CLOCKS_PER_SEC));
- 		 start_t=clock();
- 		}    	
-	writelines(); /* write out lines in sorted order */
- 	if(verbose)
- 		{
- 		 end_t=clock();
- 		 fprintf(stderr,"nsort: output written in %.3f secs\n",(end_t-start_t)/(double)(CLOCKS_PER_SEC));
- 		} 	
-	return 0;
-   } else {
-	fprintf(stderr,"nsort: error input too big to sort\n");
-	return 1;
-   }
-}
-
+/* nsort.c 
+   =======
+   loosely based on sort in section 5.11 from K&R "The C programming Language" 2nd edition 
+   
+   sorts stdin and prints result to stdout
+   if "-n" is present does numeric sort on 1st field, otherwise does a string sort
+   if "-q" is present allows numbers inside double quotes and sorts based on the number. -q implies -n .
+   if "-c" is present the input is a csv file (RFC 4180) so quoted fields can contain commas and newlines (and a record can therefore span several lines).
+   --field N sorts on field N (fields are comma separated, 1 is the 1st field) rather than the start of the line.
+   --header N copies the first N lines to the output unchanged, only the rest of the lines are sorted.
+   --by-column LIST (eg --by-column 2,4) sorts numerically on each of the listed fields in turn, the numbers in all the fields are only read once. 
+     With one field the result goes to stdout, otherwise the result for field N goes to the file PREFIXN.csv (the prefix is set by --out-prefix PREFIX, default nsort_col)
+   --split-by-range N writes the sorted lines to N files PREFIX1.csv ... PREFIXN.csv (default prefix nsort_part) rather than stdout, each holding a contiguous range of keys.
+   --split-size SIZE does the same but starts a new file once a file holds SIZE bytes (eg 100M). With both, lines with the same key always go to the same file and the files are written in parallel.
+   --incremental writes the sorted lines as soon as they are known, smallest first, rather than after the whole sort. Numeric sorts use a quicksort that always carries on with its leftmost part (see keysort.c),
+     string sorts split the lines into ranges of keys which are sorted in turn. stdout is flushed so the first lines are seen straight away (eg nsort --incremental | less).
+   --window N and --window-key D sort a stream that is already nearly in order (eg events that arrive up to a few seconds late) as it is read, using a heap of lines waiting to be output.
+     The smallest line is output when more than N lines are waiting, or (numeric sorts) when a number more than D bigger than its number has been read. Memory used is bounded so the input can be endless.
+   --cache-dir DIR saves sorted outputs in directory DIR named from a hash of the input (worked out as it is read) and the options, so sorting the same input again just copies the output.
+     The least recently used files are deleted to keep the total size below --cache-max SIZE (default 1G), see cache.c.
+   -j N uses at most N threads for each parallel step (converting keys, the sorts, and writing split files), and --cpus LIST (eg 0-3,8) pins nsort (and its --workers processes) to those processors.
+     By default all the processors this process can use are used, and smaller inputs use fewer threads. -j N applies to each --workers process.
+   --memory SIZE sets the memory the lines read can use (eg 2G), once this is used up the lines are sorted and written to a temporary file as a run, then more lines are read.
+     At the end the runs are merged to stdout. The default is 50% of the memory available, which on Linux allows for a container (cgroup) memory limit (see threads.c).
+     With --workers N the budget is shared: this process holds the lines in half of it and each worker is given --memory of 1/N of the other half, if the input does not fit in
+     this process's half it is sorted here in runs rather than by the workers.
+     -c , --by-column, --key-expr, --split-by-range, --split-size and --incremental need all the input in memory, so they stop with an error if it is bigger than the budget.
+   --workers N sorts using N worker processes (copies of nsort connected by pipes), each sorting a range of keys chosen from a sorted sample of the lines (see workers.c)
+   --key-expr EXPR sorts numerically on the value of an expression calculated from the fields of each line (eg c2+c3 , abs(c4) or c5/c2 ), see keyexpr.c
+   --dict for string sorts where the field sorted on has few different values, builds a sorted dictionary of the values then sorts on their positions in the dictionary (see dictsort.c)
+   --engine NAME selects the sort algorithm used: auto (the default, chosen from a sample of the input), qsort, radix (numeric sorts only), merge (for nearly sorted input), dict (the same as --dict)
+     count (numeric sorts where the numbers are integers in a small range), lcp (string sorts of whole lines that have long common prefixes)
+     burst (string sorts of whole lines, for very large inputs) dpqsort (numeric sorts, a dual-pivot quicksort that needs no extra memory)
+     vqsort (numeric sorts, a quicksort that compares 4 numbers at once using AVX2 instructions) msd (string sorts of whole lines, a radix sort using all processors)
+     or flag (numeric sorts, an in place radix sort that needs no extra memory)
+   --double numeric sorts compare the numbers as doubles: lines are sorted on the numbers rounded to floats (4 byte keys), then only lines whose floats are the same
+     have their numbers converted to doubles (once, the values are saved) to sort them. This gives the same order as comparing doubles for all the lines.
+   --exact numeric sorts compare the numbers exactly as decimal digits (like GNU sort -n) rather than converting them to floats, so long numbers never compare equal unless they are (see decnum.c)
+   if -n present non-numeric lines will sort first (so a csv files header should stay first)
+   -u only displays unique (different) lines (so deletes duplicates).
+   -h or -? print basic helptext and exit.
+   
+   Has limits on line length and total number of lines as it reads the whole input into RAM before sorting it.
+   
+   sorts into increasing order.
+   
+   This version (c) Peter Miller 2022.
+   Uses (optionally, but by default) fast_atof from https://github.com/p-j-miller/ya-sprintf  and qsort from https://github.com/p-j-miller/yasort-and-yamedian
+   
+   Version 1.0 31/12/2020 - 1st version on github
+   Version 1.1 1/2/2022 - swapped to use qsort.c from yasort-and-yamedian as this is always O(n*log(n)) execution speed and all available processors for sorting which can be a lot faster
+   						- on a 2 processor PC the sort phase was 2.5* faster and the complete time 1.5* faster on the 1M line test file.
+   Version 1.2 - added -c (csv files as per RFC 4180) and --field N options. In csv mode the whole input is read into one buffer which is split into records using SIMD instructions (see csv.c)
+               - added --header N option so header lines do not take part in the sort (in all modes, not just numeric sorts)
+               - added --by-column LIST option. The listed fields are converted to floats in parallel (see threads.c), then for each field the lines are sorted with a radix sort on these numbers (see keysort.c)
+               - added --key-expr EXPR option. The expression is compiled to bytecode which is run once for each line to give the number to sort on (see keyexpr.c)
+               - added --dict option. For 1000 different keys in 100M lines this turns the sort into two linear passes (see dictsort.c)
+               - added --engine NAME option. By default a sample of the input is measured (presortedness, duplicate keys, key type, line length) to choose the sort algorithm (see plan.c), -v prints the plan.
+                 Numeric sorts now default to a radix sort on float keys, and string sorts of nearly sorted or reversed input use a natural merge sort (see mergesort.c)
+               - added a counting sort engine (--engine count) for numeric sorts where the numbers are integers in a small range, which the planner uses when a sample of the input looks like this.
+               - added a LCP merge sort engine (--engine lcp) for string sorts of lines with long common prefixes (eg URLs), common prefixes are only compared once (see strsort.c)
+               - added a burstsort engine (--engine burst) for string sorts of very large inputs, this avoids most of the cache misses qsort() has (see strsort.c)
+               - added a dual-pivot quicksort engine (--engine dpqsort) for numeric sorts, this sorts the float keys in place so needs less memory than the radix sort (see keysort.c)
+               - added a vectorised quicksort engine (--engine vqsort) for numeric sorts, its partition compares 4 keys with the pivot at once using AVX2 instructions (see keysort.c)
+               - added a parallel MSD radix sort engine (--engine msd) for string sorts of whole lines, all the threads share the first pass then sort separate buckets (see strsort.c)
+               - added an American flag sort engine (--engine flag) for numeric sorts, a radix sort done in place so it needs no second array of keys (see keysort.c).
+                 The radix sort now falls back to this if there is not enough memory for its second array.
+               - added --double option, numbers are still sorted on floats but lines with the same float are then sorted on their doubles, which are only worked out for these lines (see keysort.c)
+               - added --exact option, numbers are compared exactly by their digits. Each number is described once (where its digits start, how many integer digits it has),
+                 the lines are radix sorted on a key made from the first 6 digits, then lines with the same key are compared by number of integer digits then memcmp() of the digits (see decnum.c)
+               - added --split-by-range N and --split-size SIZE options. The sorted lines are split into contiguous ranges (moved so lines with the same key are never split) which are
+                 written to separate files by parallel threads, so sharded outputs need no second pass to split them.
+               - added --workers N option. Lines are sent to N worker processes by the range their key is in (ranges are chosen from a sorted sample), the workers sort in parallel and
+                 as the ranges do not overlap their outputs are simply copied to stdout in turn. Lines are sent to and from workers as runs of '\n' terminated lines (see workers.c).
+               - added --incremental option. Parts of the input are sorted smallest first (for numeric sorts a quicksort that carries on with its leftmost part, for string sorts ranges of keys
+                 from a sorted sample) and lines are written as soon as all the lines before them are sorted, so the first output appears long before the sort finishes while the total time stays close to a normal sort.
+               - added --window N and --window-key D options to sort a nearly ordered stream with bounded memory and latency. Lines wait in a heap keyed on the number sorted on (converted once per line),
+                 and the smallest is output once no line that sorts before it can still arrive within the window.
+                 For --window-key the numbers are compared as doubles (exactly with decnum_cmp_diff() for --exact), so timestamps in seconds since 1970 work.
+               - added --cache-dir DIR and --cache-max SIZE options. Sorted outputs are saved in DIR named from a 128 bit hash of the input (worked out 8 bytes at a time as the input is read)
+                 and of the options, so a repeat sort of the same input is just a copy. The directory is kept to SIZE bytes by deleting the least recently used outputs (see cache.c).
+               - the number of threads now allows for the processor affinity mask and container (cgroup) cpu limits, and if the input would use more than half of the memory available
+                 (again allowing for container limits), or the size set by --memory SIZE, it is sorted in runs written to temporary files which are then merged.
+               - added -j N and --cpus LIST to limit the threads used and pin nsort to a set of processors, qsort.c (used by the Windows build) now starts its threads with threads.c so it follows these too
+
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2020,2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+/* Define __USE_MINGW_ANSI_STDIO to 1 to use C99 compatible stdio functions on MinGW. see for example https://stackoverflow.com/questions/44382862/how-to-printf-a-size-t-without-warning-in-mingw-w64-gcc-7-1 */
+// #define __USE_MINGW_ANSI_STDIO 1   /* if this is defined then writing to stdout > NUL is VERY slow (70 secs vs 4 secs) ! Note strtof() etc are still much slower than fast_atof() etc */
+/* use mingw64 as compiler - latest TDM-GCC 10.3.0 has __USE_MINGW_ANSI_STDIO set to 1 by default so is very slow writing to NUL: and much slower writing to stdout generally  */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h> /* for bool */
+#include <ctype.h>
+#include <float.h>
+#include <limits.h> /* for UINT_MAX */
+#include <time.h>
+#include <math.h>
+#include <stdint.h>  /* for int64_t etc */
+#include <inttypes.h> /* to print uint64_t */
+#include <sys/stat.h> /* for fstat() to see if stdin is a file for --window */
+#include "qsort.h" /* qsort.c used */
+#include "csv.h" /* csv file support */
+#include "threads.h" /* to run functions in parallel */
+#include "keysort.h" /* sorting using numeric keys */
+#include "keyexpr.h" /* --key-expr */
+#include "dictsort.h" /* --dict */
+#include "mergesort.h" /* natural merge sort for nearly sorted input */
+#include "plan.h" /* choice of sort engine (--engine NAME) */
+#include "strsort.h" /* string sorts that skip common prefixes */
+#include "decnum.h" /* --exact */
+#include "workers.h" /* --workers N */
+#include "cache.h" /* --cache-dir DIR */
+
+#define VERSION "1.2" /* adds csv support */
+
+#define USE_FAST_ATOF /* if defined use my fast_atol() from ya-sprintf [which should be much faster] , otherwise use strtod() from the standard library */
+
+#if defined(USE_FAST_ATOF) 
+double fast_atof(const char *string,bool * not_number)	; // converts string to double. Skips leading whitespace. sets not_number true if no number found (and returns 0) otherwise sets it false and returns number read.
+double fast_strtod(const char *s,char ** endptr);// like strtod() but faster
+double fast_atof_nan(const char *s);// like fast_atof, but returns NAN if the string does not start with a valid number
+float fast_strtof(const char *s,char **endptr); // like strtof() but faster
+void fast_strtof_batch(const char *const *s,size_t n,float *v,char **endptrs); // v[i]=fast_strtof(s[i],&endptrs[i]) for i=0..n-1, but faster
+void fast_strtod_batch(const char *const *s,size_t n,double *v,char **endptrs); // v[i]=fast_strtod(s[i],&endptrs[i]) for i=0..n-1, but faster
+extern const int fast_strtof_u; // tell rest of system we are using u64's or u32's (only useful for diagnostics/debugging)
+#endif
+
+char *strdup(const char *s); // not in gcc 5.1.0 string.h
+
+#define nsort_num_float /* if defined do numeric sorts with float rather than double */
+
+// following variables used internally by readline():
+static const unsigned int FIRST_SIZE=256; /* initial size of line buffer start at eg 256, size is doubled if its too small */
+static char *buf=NULL; /* input buffer */
+static unsigned int buf_size=0; /* input buffer size, 0 means not yet allocated */
+
+// variables used by readlines (also uses FIRST_SIZE from above)
+static char **lineptr=NULL; /* pointers to lines of text */
+static unsigned int lines_buf_size=0; // current size of lineptr[]
+static unsigned int nlines=0; // nos lines actually in use in lineptr
+static unsigned int nheader=0; // nos header lines at the start of lineptr[] that are not sorted (min of header_lines and nlines)
+
+
+
+bool quoted_numbers=false; /* if true allows numbers with double quotes ("123") to be sorted numerically */
+bool do_uniq=false; /* set to true when -u (unique) option specified on command line */
+bool verbose=false; // set to 1 if -v option present
+bool exact_numbers=false; /* set to true by --exact, numeric sorts compare numbers exactly as decimal digits (see decnum.c) */
+bool double_keys=false; /* set to true by --double, numeric sorts compare numbers as doubles (when nsort_num_float is defined they are otherwise compared as floats) */
+bool csv_mode=false; /* set to true when -c option specified - input is a csv file (fields can be quoted, and quoted fields can contain newlines) */
+unsigned int sort_field=1; /* field to sort on (set by --field N) , 1 is the 1st field (ie the start of the line) */
+static unsigned int csv_key_field=0; /* -c: the field whose offset readcsv() stored in front of each record with csv_key_offsets() (0 if none) */
+unsigned int header_lines=0; /* number of header lines (set by --header N) which are output unchanged before the sorted lines */
+unsigned int *by_columns=NULL; /* list of fields to sort on in turn (set by --by-column LIST) */
+unsigned int nby_columns=0; /* number of fields in by_columns[], 0 means --by-column not used */
+const char *out_prefix=NULL; /* prefix for output files (set by --out-prefix PREFIX), NULL for the default (nsort_col for --by-column, nsort_part for --split-by-range and --split-size) */
+unsigned int split_files=0; /* number of output files for --split-by-range N, 0 if not used */
+uint64_t split_size=0; /* size in bytes of each output file for --split-size SIZE, 0 if not used */
+unsigned int nos_workers=0; /* number of worker processes for --workers N, 0 if not used */
+bool worker_mode=false; /* set by --worker, this is a worker process started by --workers N so it just sorts stdin to stdout */
+static char **worker_argv=NULL; /* command line for the worker processes, the arguments this program was given with --worker added */
+bool incremental=false; /* set by --incremental, lines are output smallest first as soon as they are sorted rather than after the whole sort */
+unsigned int window_lines=0; /* --window N, max number of lines waiting to be output when sorting a stream, 0 if not used */
+bool window_by_key=false; /* set by --window-key D */
+double window_key=0; /* --window-key D, a line is output once a number more than D bigger than its number has been read */
+const char *window_key_text="0"; /* --window-key D as given on the command line (for --exact) */
+#define CACHE_MAX_DEFAULT (UINT64_C(1)<<30) /* default for --cache-max SIZE (1G) */
+const char *cache_dir=NULL; /* --cache-dir DIR, directory where sorted outputs are kept so sorting the same input again just copies the output (see cache.c), NULL if not used */
+uint64_t cache_max=CACHE_MAX_DEFAULT; /* --cache-max SIZE, max total size of the files in the cache directory */
+static struct cache_hash input_hash; /* hash of the input, worked out as it is read when --cache-dir is used */
+static char *cache_file=NULL; /* the cache file to save the output in, set when --cache-dir is used and the output was not already in the cache */
+#define MEMORY_BUDGET_PERCENT 50 /* by default the lines read can use this % of memory_limit() before they are sorted in runs (the rest is for the sort itself and other programs) */
+#define LINE_OVERHEAD 48 /* estimate of the memory used for each line as well as its characters: malloc() overhead, its pointer in lineptr[] (allowing for lineptr[] being doubled) and the arrays used by the sort */
+uint64_t memory_budget=0; /* memory the lines read can use before they are sorted in runs (--memory SIZE or MEMORY_BUDGET_PERCENT of memory_limit() ), 0 means no limit */
+bool memory_set=false; /* set by --memory SIZE */
+static uint64_t lines_memory=0; /* estimate of the memory used by the lines read so far (for memory_budget) */
+static bool more_input=false; /* set by readlines() if it stopped reading as the lines used up memory_budget, so the input is sorted in runs by sort_external() */
+static const char *whole_input=NULL; /* the option (eg "-c") that needs all the input in memory so cannot be sorted in runs, readlines() then fails if the input uses up memory_budget. NULL if none */
+struct keyexpr *key_expr=NULL; /* compiled expression to sort on (set by --key-expr EXPR), NULL if not used */
+static const char *key_expr_text=""; /* the text of EXPR for --key-expr EXPR (for --cache-dir) */
+enum sort_engine engine=ENGINE_AUTO; /* sort algorithm to use (set by --engine NAME, --dict is the same as --engine dict), by default chosen from a sample of the input */
+#define DICT_MAX_KEYS (1<<20) /* max size of dictionary for --dict */
+#define DICT_MIN_LINES_PER_KEY 8 /* --dict only used if there are on average at least this many lines for every different key */
+
+int readlines(void);
+static int readmore(void);
+void writelines(FILE *fp,char **body);
+static void write_lines(FILE *fp,char **body,unsigned int n);
+static void cache_save(FILE *cf,bool ok);
+int numcmp(const char *, const char *);
+
+
+ /* return pointer to the start of the field we are sorting on (set by --field N) */
+static inline const char *key_field(const char *s)
+{const char *f;
+ if(sort_field<=1) return s;
+ if(sort_field==csv_key_field) return csv_key(s); // -c: offset of the field was found when the record was read
+ f=csv_field(s,sort_field,csv_mode);
+ return f==NULL ? "" : f; // lines without enough fields are treated as if the field was empty
+}
+
+ /*  these are the compare routines for qsort() */
+int mysCompare (const void * a, const void * b ) { /* compare as strings */
+    const char *pa = key_field(*(const char**)a);
+    const char *pb = key_field(*(const char**)b);
+    return strcmp(pa,pb);
+}
+
+int mynCompare (const void * a, const void * b ) { /* compare as numbers */
+    const char *pa = key_field(*(const char**)a);
+    const char *pb = key_field(*(const char**)b);
+    return numcmp(pa,pb);
+}
+
+
+/* numcmp: compare s1 and s2 numerically */
+/* this version allows numbers in quotes if -q option is specified on command line (quoted_numbers=true), or if the input is a csv file (-c) */
+/* also treats non-numbers as very large negative numbers to the sort first [ so a csv file header wil stay at the front of the file, but use --header 1 to be sure of this ] */
+/* if numbers are identical then sort as strings. This is needed for -u option, but defines order so seens sensible anyway */
+
+int numcmp(const char *s1, const char  *s2)
+{
+#ifdef  nsort_num_float /* if defined do numeric sorts with float rather tha double */	
+ float v1,v2;
+ char *sret;
+#else
+ double v1, v2;
+
+#ifdef USE_FAST_ATOF 	 
+ bool not_number;
+#else
+  char *sret;
+#endif   
+#endif 
+  while(isspace(*s1)) ++s1; /* skip initial whitespace */
+ if((quoted_numbers || csv_mode) && *s1=='"') 
+ 	{++s1; // skip " if allowed (no need to worry about trailing " as that will just terminate the number )
+ 	}
+#ifdef  nsort_num_float /* if defined do numeric sorts with float rather tha double */	
+ #ifdef USE_FAST_ATOF 
+ v1=fast_strtof(s1,&sret);
+ #else
+ v1=strtof(s1,&sret);
+ #endif
+ if(sret==s1)  v1= -FLT_MAX; // very large negative number if no number found so sorts first	
+#else
+#ifdef USE_FAST_ATOF 	
+ v1=fast_atof(s1,&not_number);
+ if(not_number) v1= -DBL_MAX; // very large negative number if no number found so sorts first
+#else
+ v1=strtod(s1,&sret);
+ if(sret==s1)  v1= -DBL_MAX; // very large negative number if no number found so sorts first
+#endif
+#endif 
+ while(isspace(*s2)) ++s2; /* skip initial whitespace */
+ if((quoted_numbers || csv_mode) && *s2=='"') ++s2; // skip " if allowed  
+#ifdef  nsort_num_float /* if defined do numeric sorts with float rather than double */	
+ #ifdef USE_FAST_ATOF 
+ v2=fast_strtof(s2,&sret);
+ #else
+ v2=strtof(s2,&sret);
+ #endif
+ if(sret==s2)  v2= -FLT_MAX; // very large negative number if no number found so sorts first
+#else 
+#ifdef USE_FAST_ATOF  
+ v2=fast_atof(s2,&not_number);
+ if(not_number) v2= -DBL_MAX; // very large negative number if no number found so sorts first
+#else
+ v2=strtod(s2,&sret);
+ if(sret==s2)  v2= -DBL_MAX; // very large negative number if no number found so sorts first
+#endif  
+#endif
+ if(v1==v2)
+ 	return strcmp(s1,s2);	
+ if (v1 < v2)
+	return -1;
+ else
+ 	return 1;	
+}
+
+
+
+/* writelines: write output lines in sorted order to fp. The header lines are lineptr[0..nheader-1] and the sorted lines are body[0..nlines-nheader-1] */
+/* if -u (unique) option set then only print lines that are different to previous line */
+/* header lines (--header N) are always printed, and are not compared to the sorted lines for -u */
+/* if the output to stdout is to be saved in the cache (--cache-dir DIR) it is then written to the cache file as well */
+void writelines(FILE *fp,char **body)
+{FILE *cf;
+ write_lines(fp,body,nlines-nheader);
+ if(fp==stdout && cache_file!=NULL && (cf=cache_create(cache_file))!=NULL)
+ 	{write_lines(cf,body,nlines-nheader);
+ 	 cache_save(cf,true);
+ 	}
+}
+
+/* cache_save: cf is a copy of the output written to stdout (from cache_create(cache_file) ), add it to the cache if ok is true otherwise delete it. Does nothing if cf is NULL */
+/* --incremental and --workers N write stdout as they go, so they write each block to cf as well and call this at the end */
+static void cache_save(FILE *cf,bool ok)
+{if(cf==NULL) return;
+ if(!ok)
+ 	cache_discard(cf,cache_file);
+ else if(!cache_commit(cf,cache_file,cache_max) && verbose)
+ 	fprintf(stderr,"nsort: could not save the output in the cache as %s\n",cache_file);
+}
+
+/* write_lines: as writelines() but only writes n sorted lines body[0..n-1] (used by --split-by-range and --split-size to write each file) */
+static void write_lines(FILE *fp,char **body,unsigned int n)
+{
+ unsigned int i;
+ for (i = 0; i < nheader; i++)
+ 	fprintf(fp,"%s\n", lineptr[i]);
+ for (i = 0; i < n; i++)
+ 	{if(!do_uniq || i==0 ||  strcmp(body[i-1],body[i])) // always print 1st sorted line, or if do_uniq is false. if do_uniq is true and not 1st line print lines that are different
+		fprintf(fp,"%s\n", body[i]);
+	}
+}
+
+/* numkey: return the number at the start of s (which is the start of the field being sorted on) as a float, following the same rules as numcmp() */
+/* when numcmp() uses doubles this is the number rounded to a float, so lines with the same float may still need to be compared with numcmp() */
+static float numkey(const char *s)
+{char *sret;
+#ifdef  nsort_num_float /* if defined do numeric sorts with float rather than double */
+ float v;
+#else
+ double v;
+#endif
+ while(isspace(*s)) ++s; /* skip initial whitespace */
+ if((quoted_numbers || csv_mode) && *s=='"') ++s; // skip " if allowed
+#ifdef  nsort_num_float
+ #ifdef USE_FAST_ATOF
+ v=fast_strtof(s,&sret);
+ #else
+ v=strtof(s,&sret);
+ #endif
+ if(sret==s)  v= -FLT_MAX; // very large negative number if no number found so sorts first
+ else if(double_keys && v< -FLT_MAX) v= -FLT_MAX; // --double: a number too big for a float must not sort before lines with no number, it has the same key as them and the doubles then decide the order
+#else
+ #ifdef USE_FAST_ATOF
+ v=fast_strtod(s,&sret);
+ #else
+ v=strtod(s,&sret);
+ #endif
+ if(sret==s)  v= -DBL_MAX; // very large negative number if no number found so sorts first
+#endif
+ return (float)v;
+}
+
+#define PAR_MIN_LINES 10000 /* min number of lines worth giving to a thread */
+
+struct _lineblock /* a block of lines to be processed by a thread, see for_lines_parallel() */
+	{char **lines; // lines to process
+	 unsigned int from,to; // process lines[from..to-1]
+	 void *data; // data for the function processing the lines
+	};
+
+/* for_lines_parallel: split lines[0..n-1] into blocks and call func() for each block (which is passed a struct _lineblock *), using parallel threads when n is large enough */
+/* returns the number of threads used, or 0 if there was not enough memory (in which case func() has not been called) */
+static unsigned int for_lines_parallel(char **lines,unsigned int n,void (*func)(void *),void *data)
+{unsigned int t,nthreads=(unsigned int)threads_for(n,PAR_MIN_LINES);
+ struct _lineblock *blocks;
+ thread_t *th;
+ bool *started;
+ blocks=calloc(nthreads,sizeof(struct _lineblock));
+ th=calloc(nthreads,sizeof(thread_t));
+ started=calloc(nthreads,sizeof(bool));
+ if(blocks==NULL || th==NULL || started==NULL)
+ 	{free(blocks);
+ 	 free(th);
+ 	 free(started);
+ 	 return 0;
+ 	}
+ for(t=0;t<nthreads;++t)
+ 	{blocks[t].lines=lines;
+ 	 blocks[t].from=(unsigned int)(((uint64_t)n*t)/nthreads);
+ 	 blocks[t].to=(unsigned int)(((uint64_t)n*(t+1))/nthreads);
+ 	 blocks[t].data=data;
+ 	}
+ run_blocks(func,blocks,sizeof(struct _lineblock),(int)nthreads,th,started);
+ free(blocks);
+ free(th);
+ free(started);
+ return nthreads;
+}
+
+static void parse_columns(void *arg) /* convert the numbers in the fields listed in by_columns[] into floats, can be run as a thread by for_lines_parallel() */
+{struct _lineblock *p=arg;
+ float **keys=p->data; // keys[c][i] is set to the number in field by_columns[c] of lines[i]
+ unsigned int i,c;
+ const char *f;
+ for(i=p->from;i<p->to;++i)
+ 	for(c=0;c<nby_columns;++c)
+ 		{f=csv_field(p->lines[i],by_columns[c],csv_mode);
+ 		 keys[c][i]=numkey(f==NULL ? "" : f);
+ 		}
+}
+
+static const char *num_start(const char *s) /* skip the whitespace (and " if allowed) before a number, as numcmp() does */
+{while(isspace(*s)) ++s;
+ if((quoted_numbers || csv_mode) && *s=='"') ++s;
+ return s;
+}
+
+/* strtie: compare s1 and s2 (which are the start of the fields being sorted on) as strings, as numcmp() does when the numbers are identical */
+static int strtie(const char *s1,const char *s2)
+{return strcmp(num_start(s1),num_start(s2));
+}
+
+/* dblkey: return the number at the start of s (which is the start of the field being sorted on) as a double (used for --double) */
+static double dblkey(const char *s)
+{char *sret;
+ double v;
+ s=num_start(s);
+#ifdef USE_FAST_ATOF
+ v=fast_strtod(s,&sret);
+#else
+ v=strtod(s,&sret);
+#endif
+ if(sret==s)  v= -DBL_MAX; // very large negative number if no number found so sorts first
+ return v;
+}
+
+/* dblcmp: compare s1 and s2 numerically as doubles (--double), identical numbers are compared as strings */
+static int dblcmp(const char *s1,const char *s2)
+{double v1=dblkey(s1),v2=dblkey(s2);
+ if(v1<v2) return -1;
+ if(v1>v2) return 1;
+ return strtie(s1,s2);
+}
+
+static int mydCompare(const void *a,const void *b) /* compare as numbers using doubles (--double) */
+{return dblcmp(key_field(*(const char**)a),key_field(*(const char**)b));
+}
+
+/* exactcmp: compare s1 and s2 numerically using their decimal digits (--exact), identical numbers are compared as strings */
+static int exactcmp(const char *s1,const char *s2)
+{struct decnum d1,d2;
+ int r;
+ s1=num_start(s1);
+ s2=num_start(s2);
+ decnum_parse(&d1,s1);
+ decnum_parse(&d2,s2);
+ if((r=decnum_cmp(&d1,&d2))!=0) return r;
+ return strcmp(s1,s2);
+}
+
+static int myxCompare(const void *a,const void *b) /* compare as numbers exactly (--exact) */
+{return exactcmp(key_field(*(const char**)a),key_field(*(const char**)b));
+}
+
+/* numtie: compare s1 and s2 (which are the start of the fields being sorted on) when numkey() gives the same value for both */
+/* when numcmp() uses floats the numbers must be identical, so this just does the string comparison that numcmp() would do (unless --double is used) */
+static int numtie(const char *s1,const char *s2)
+{
+#ifdef  nsort_num_float
+ return double_keys ? dblcmp(s1,s2) : strtie(s1,s2);
+#else
+ return numcmp(s1,s2); // floats are the same, but the doubles may not be
+#endif
+}
+
+static char **tie_body; /* lines being sorted by sort_by_columns() or sort_numeric() */
+static int numTieCompare(uint32_t l1,uint32_t l2) /* compare lines with the same float key, used by sort_numeric_ties() */
+{return numtie(key_field(tie_body[l1]),key_field(tie_body[l2]));
+}
+
+static double lineDoubleKey(uint32_t l) /* number being sorted on for line l as a double, used with sort_ties_by_value() for --double */
+{return dblkey(key_field(tie_body[l]));
+}
+
+static int strTieCompare(uint32_t l1,uint32_t l2) /* compare lines with the same number as strings, used with sort_ties_by_value() for --double */
+{return strtie(key_field(tie_body[l1]),key_field(tie_body[l2]));
+}
+
+static void sort_numeric_ties(kitem_t *items,size_t n) /* sort runs of items with the same float key, as doubles if --double is used */
+{if(double_keys)
+ 	sort_ties_by_value(items,n,lineDoubleKey,strTieCompare);
+ else
+ 	sort_ties(items,n,numTieCompare);
+}
+
+/* sort_by_columns: numerically sort lines on each of the fields in by_columns[] in turn (--by-column LIST) */
+/* The fields are all converted to floats once (in parallel), then for each field the lines are radix sorted on its floats, lines with the same float are then sorted using sort_numeric_ties() */
+/* returns 0 if OK, 1 on error */
+static int sort_by_columns(void)
+{unsigned int n=nlines-nheader; // lines to sort
+ unsigned int i,c,nthreads;
+ float **keys=calloc(nby_columns,sizeof(float *));
+ kitem_t *items=malloc(n*sizeof(kitem_t)+1);
+ char **sorted=malloc(n*sizeof(char *)+1);
+ clock_t start_t,end_t;
+ char **col_body=lineptr+nheader;
+ start_t=clock();
+ if(keys==NULL || items==NULL || sorted==NULL)
+ 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 return 1;
+ 	}
+ for(c=0;c<nby_columns;++c)
+ 	if((keys[c]=malloc(n*sizeof(float)+1))==NULL)
+ 		{fprintf(stderr,"nsort: error input too big to sort\n");
+ 		 return 1;
+ 		}
+ if((nthreads=for_lines_parallel(col_body,n,parse_columns,keys))==0) // parse fields in parallel, each thread does a block of lines
+ 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 return 1;
+ 	}
+ if(verbose)
+ 	{end_t=clock();
+ 	 fprintf(stderr,"nsort: %u field(s) converted to numbers using %u thread(s) in %.3f secs\n",nby_columns,nthreads,(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 	}
+ for(c=0;c<nby_columns;++c)
+ 	{FILE *fp=stdout;
+ 	 start_t=clock();
+ 	 for(i=0;i<n;++i)
+ 	 	items[i]=KITEM(float_key(keys[c][i]),i);
+ 	 if(radix_sort_items(items,n)<0)
+ 	 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 	 return 1;
+ 	 	}
+ 	 sort_field=by_columns[c]; // used by key_field() for lines with the same float key
+ 	 tie_body=col_body;
+ 	 sort_numeric_ties(items,n);
+ 	 for(i=0;i<n;++i)
+ 	 	sorted[i]=col_body[KITEM_LINE(items[i])];
+ 	 if(verbose)
+ 	 	{end_t=clock();
+ 	 	 fprintf(stderr,"nsort: sort on field %u took %.3f secs\n",by_columns[c],(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 	 	 start_t=clock();
+ 	 	}
+ 	 if(nby_columns>1)
+ 	 	{// more than one field, so output goes to a file for each field
+ 	 	 const char *prefix= out_prefix!=NULL ? out_prefix : "nsort_col";
+ 	 	 char *filename=malloc(strlen(prefix)+20);
+ 	 	 if(filename==NULL)
+ 	 	 	{fprintf(stderr,"nsort: out of memory\n");
+ 	 	 	 return 1;
+ 	 	 	}
+ 	 	 sprintf(filename,"%s%u.csv",prefix,by_columns[c]);
+ 	 	 if((fp=fopen(filename,"w"))==NULL)
+ 	 	 	{fprintf(stderr,"nsort: cannot create output file %s\n",filename);
+ 	 	 	 return 1;
+ 	 	 	}
+ 	 	 if(verbose) fprintf(stderr,"nsort: writing lines sorted on field %u to %s\n",by_columns[c],filename);
+ 	 	 free(filename);
+ 	 	}
+ 	 writelines(fp,sorted);
+ 	 if(fp!=stdout && fclose(fp)!=0)
+ 	 	{fprintf(stderr,"nsort: error writing output file\n");
+ 	 	 return 1;
+ 	 	}
+ 	 if(verbose)
+ 	 	{end_t=clock();
+ 	 	 fprintf(stderr,"nsort: output written in %.3f secs\n",(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 	 	}
+ 	}
+ return 0;
+}
+
+static float linekey(const char *line) /* number being sorted on for line, used by the planner */
+{return numkey(key_field(line));
+}
+
+static struct decnum *exact_nums; /* for --exact the description of the number in each line being sorted by sort_numeric(), otherwise NULL */
+
+#define NUMKEY_BATCH 64 /* numbers converted together by numkeys() */
+
+/* numkeys: keys[i]=linekey(lines[i]) for i=0..n-1, converting NUMKEY_BATCH numbers at a time with fast_strtof_batch() (or fast_strtod_batch() ) which is faster than one at a time */
+static void numkeys(char **lines,unsigned int n,float *keys)
+{unsigned int i;
+#if defined(USE_FAST_ATOF)
+ unsigned int j,m;
+ const char *s[NUMKEY_BATCH];
+ char *sret[NUMKEY_BATCH];
+ #ifdef  nsort_num_float
+ float v[NUMKEY_BATCH];
+ #else
+ double v[NUMKEY_BATCH];
+ #endif
+ for(i=0;i<n;i+=m)
+ 	{m= n-i<NUMKEY_BATCH ? n-i : NUMKEY_BATCH;
+ 	 for(j=0;j<m;++j)
+ 	 	s[j]=num_start(key_field(lines[i+j]));
+ #ifdef  nsort_num_float
+ 	 fast_strtof_batch(s,m,v,sret);
+ 	 for(j=0;j<m;++j)
+ 	 	{keys[i+j]= sret[j]==s[j] ? -FLT_MAX : v[j]; // the same as numkey()
+ 	 	 if(double_keys && keys[i+j]< -FLT_MAX) keys[i+j]= -FLT_MAX;
+ 	 	}
+ #else
+ 	 fast_strtod_batch(s,m,v,sret);
+ 	 for(j=0;j<m;++j)
+ 	 	keys[i+j]=(float)(sret[j]==s[j] ? -DBL_MAX : v[j]); // the same as numkey()
+ #endif
+ 	}
+#else
+ for(i=0;i<n;++i)
+ 	keys[i]=linekey(lines[i]);
+#endif
+}
+
+static void numeric_items(void *arg) /* set the sort items for a block of lines for sort_numeric(), can be run as a thread by for_lines_parallel() */
+{struct _lineblock *p=arg;
+ kitem_t *items=p->data;
+ float keys[NUMKEY_BATCH];
+ unsigned int i,j,m;
+ if(exact_nums!=NULL)
+ 	for(i=p->from;i<p->to;++i)
+ 		{decnum_parse(&exact_nums[i],num_start(key_field(p->lines[i])));
+ 		 items[i]=KITEM(decnum_key(&exact_nums[i]),i);
+ 		}
+ else
+ 	for(i=p->from;i<p->to;i+=m)
+ 		{m= p->to-i<NUMKEY_BATCH ? p->to-i : NUMKEY_BATCH;
+ 		 numkeys(p->lines+i,m,keys);
+ 		 for(j=0;j<m;++j)
+ 		 	items[i+j]=KITEM(float_key(keys[j]),i+j);
+ 		}
+}
+
+static int exactTieCompare(uint32_t l1,uint32_t l2) /* compare lines with the same key from decnum_key() for --exact */
+{int r=decnum_cmp(&exact_nums[l1],&exact_nums[l2]);
+ if(r!=0) return r;
+ return strtie(key_field(tie_body[l1]),key_field(tie_body[l2]));
+}
+
+/* sort_numeric: numerically sort lines[0..n-1] on the field set by --field N (--engine radix, dpqsort, vqsort or flag) */
+/* the numbers are converted to floats once (in parallel), the lines are sorted on these floats using sort_items() (radix_sort_items(), quicksort_items(), vquicksort_items() or flag_sort_items()), then lines with the same float are sorted using sort_numeric_ties(), so the result is the same as qsort() with mynCompare() (or mydCompare() for --double) */
+/* for --exact the keys come from decnum_key() and lines with the same key are sorted using exactTieCompare(), so the result is the same as qsort() with myxCompare() */
+/* returns false if there is not enough memory, in which case lines[] is unchanged */
+static bool sort_numeric(char **lines,unsigned int n,int (*sort_items)(kitem_t *,size_t))
+{kitem_t *items=malloc(n*sizeof(kitem_t)+1);
+ char **sorted=malloc(n*sizeof(char *)+1);
+ unsigned int i;
+ bool ok=false;
+ exact_nums=NULL;
+ if(exact_numbers && (exact_nums=malloc(n*sizeof(struct decnum)+1))==NULL)
+ 	{free(items);
+ 	 items=NULL; // not enough memory
+ 	}
+ if(items!=NULL && sorted!=NULL && for_lines_parallel(lines,n,numeric_items,items)>0 && (sort_items(items,n)==0 || flag_sort_items(items,n)==0)) // if sort_items() runs out of memory use the in place radix sort
+ 	{tie_body=lines;
+ 	 if(exact_nums!=NULL)
+ 	 	sort_ties(items,n,exactTieCompare);
+ 	 else
+ 	 	sort_numeric_ties(items,n);
+ 	 for(i=0;i<n;++i)
+ 	 	sorted[i]=lines[KITEM_LINE(items[i])];
+ 	 memcpy(lines,sorted,n*sizeof(char *));
+ 	 ok=true;
+ 	}
+ free(items);
+ free(sorted);
+ free(exact_nums);
+ exact_nums=NULL;
+ return ok;
+}
+#define RANGE_SAMPLE 256 /* lines sampled for each range to choose the ranges in split_by_range() */
+
+struct _rangeparams /* data for find_ranges() */
+	{char **splitters; // the first range is lines <= splitters[0], the next lines > splitters[0] and <= splitters[1] etc
+	 unsigned int nsplitters; // number of ranges-1
+	 int (*cmp)(const void *,const void *); // compare routine for the sort
+	 unsigned int *range; // range[i] is set to the range line i is in
+	};
+
+static void find_ranges(void *arg) /* find the range for each of a block of lines for split_by_range(), can be run as a thread by for_lines_parallel() */
+{struct _lineblock *p=arg;
+ struct _rangeparams *r=p->data;
+ unsigned int i,lo,hi,mid;
+ for(i=p->from;i<p->to;++i)
+ 	{lo=0;
+ 	 hi=r->nsplitters;
+ 	 while(lo<hi) // binary search for the first splitter >= the line
+ 	 	{mid=lo+(hi-lo)/2;
+ 	 	 if(r->cmp(&p->lines[i],&r->splitters[mid])<=0)
+ 	 	 	hi=mid;
+ 	 	 else
+ 	 	 	lo=mid+1;
+ 	 	}
+ 	 r->range[i]=lo;
+ 	}
+}
+
+/* split_by_range: split lines[0..n-1] into nparts ranges of keys, so all the lines in a range sort before (or the same as) all the lines in the next range */
+/* the ranges are chosen from a sorted sample of the lines (RANGE_SAMPLE lines for each range), the range for each line is found by a binary search using cmp() (in parallel),
+   so lines that compare equal are always in the same range. The lines in range k are put in out[start[k]..start[k+1]-1] in the order they were in lines[] (which keeps them in memory order for the sort).
+   start[] must have room for nparts+1 values. Returns false if there is not enough memory */
+static bool split_by_range(char **lines,unsigned int n,int (*cmp)(const void *,const void *),unsigned int nparts,char **out,unsigned int *start)
+{unsigned int ns= n<RANGE_SAMPLE*nparts ? n : RANGE_SAMPLE*nparts,i,k;
+ char **sample=malloc(ns*sizeof(char *)+1);
+ struct _rangeparams r;
+ bool ok=false;
+ r.nsplitters=nparts-1;
+ r.cmp=cmp;
+ r.range=malloc(n*sizeof(unsigned int)+1);
+ r.splitters=malloc(nparts*sizeof(char *));
+ if(sample!=NULL && r.range!=NULL && r.splitters!=NULL)
+ 	{for(i=0;i<ns;++i)
+ 		sample[i]=lines[(unsigned int)(((uint64_t)n*i)/ns)];
+ 	 qsort(sample,ns,sizeof(char *),cmp);
+ 	 for(k=0;k<r.nsplitters;++k)
+ 	 	r.splitters[k]= ns>0 ? sample[(unsigned int)(((uint64_t)ns*(k+1))/nparts)] : "";
+ 	 if(n==0 || for_lines_parallel(lines,n,find_ranges,&r)>0)
+ 	 	{// put the lines for each range together (keeping their order)
+ 	 	 memset(start,0,(nparts+1)*sizeof(unsigned int));
+ 	 	 for(i=0;i<n;++i)
+ 	 	 	++start[r.range[i]+1];
+ 	 	 for(k=1;k<=nparts;++k)
+ 	 	 	start[k]+=start[k-1];
+ 	 	 for(i=0;i<n;++i)
+ 	 	 	out[start[r.range[i]]++]=lines[i];
+ 	 	 for(k=nparts;k>0;--k) // start[k] is now the end of range k, so move them back
+ 	 	 	start[k]=start[k-1];
+ 	 	 start[0]=0;
+ 	 	 ok=true;
+ 	 	}
+ 	}
+ free(sample);
+ free(r.range);
+ free(r.splitters);
+ return ok;
+}
+
+/* --incremental: the lines are sorted smallest part first, and written to stdout as soon as all the lines before them are sorted */
+#define INC_LINES_BLOCK 4096 /* string sorts with --incremental split the lines into ranges of about this many lines */
+#define INC_LINES_PARTS 256 /* max number of ranges for string sorts with --incremental, so splitting the lines takes at most 8 compares per line */
+
+struct _incremental /* state for the emit functions of sort_incremental() */
+	{char **lines; // lines being sorted
+	 kitem_t *items; // numeric sorts: items being sorted, NULL for string sorts
+	 size_t n; // number of lines
+	 size_t out; // lines[] (or items[]) before this have been written
+	 size_t sorted; // numeric sorts: items[0..sorted-1] are sorted on their keys
+	 size_t run; // numeric sorts: start of the run of items with the same key as items[sorted-1], which may carry on past sorted
+	 const char *last; // last line written (for -u)
+	 size_t flush_at; // stdout is flushed once this many lines have been written, then this is doubled
+	 FILE *cache; // copy of the output to be saved in the cache (--cache-dir DIR), NULL if not used
+	 unsigned int written; // number of lines written
+	 clock_t start_t; // when the sort started (for -v)
+	};
+
+static void inc_write(struct _incremental *p,const char *line) /* write one sorted line for sort_incremental() */
+{if(do_uniq && p->last!=NULL && strcmp(p->last,line)==0) return; // same as write_lines() for -u
+ fputs(line,stdout);
+ putchar('\n');
+ if(p->cache!=NULL)
+ 	{fputs(line,p->cache);
+ 	 putc('\n',p->cache);
+ 	}
+ p->last=line;
+ p->written++;
+}
+
+static void inc_flush(struct _incremental *p) /* flush stdout the first time lines are written, then each time the number written doubles */
+{if(p->written<p->flush_at) return;
+ if(verbose && p->flush_at==1) fprintf(stderr,"nsort: first lines output after %.3f secs\n",(clock()-p->start_t)/(double)(CLOCKS_PER_SEC));
+ fflush(stdout);
+ while(p->flush_at<=p->written) p->flush_at*=2;
+}
+
+static void emit_lines(size_t done,void *arg) /* write lines[out..done-1] which are now sorted */
+{struct _incremental *p=arg;
+ for(;p->out<done;p->out++)
+ 	inc_write(p,p->lines[p->out]);
+ inc_flush(p);
+}
+
+static void emit_items(size_t done,void *arg) /* write the lines for items[out..done-1] which are now sorted, the emit function for incremental_sort_items() */
+{struct _incremental *p=arg;
+ size_t i,end;
+ for(i= p->sorted>0 ? p->sorted : 1;i<done;++i) // lines with the same key are sorted by sort_ties() so the last run of keys is kept back until all of it is sorted
+ 	if(KITEM_KEY(p->items[i])!=KITEM_KEY(p->items[i-1])) p->run=i;
+ p->sorted=done;
+ end= done==p->n ? done : p->run;
+ if(end<=p->out) return;
+ tie_body=p->lines;
+ if(exact_nums!=NULL)
+ 	sort_ties(p->items+p->out,end-p->out,exactTieCompare);
+ else
+ 	sort_numeric_ties(p->items+p->out,end-p->out);
+ for(i=p->out;i<end;++i)
+ 	inc_write(p,p->lines[KITEM_LINE(p->items[i])]);
+ p->out=end;
+ inc_flush(p);
+}
+
+/* sort_incremental: sort lines[0..n-1] and write them to stdout smallest first as soon as they are sorted (--incremental), so the first lines are output long before the sort finishes */
+/* numeric sorts convert the numbers to keys (as sort_numeric() ) which are sorted with incremental_sort_items(). String sorts (or if there is not enough memory for the keys)
+   split the lines into ranges with split_by_range() then sort the ranges in turn with qsort(), which as the lines in each range are still in memory order is faster than partitioning with a quicksort */
+/* the header lines are written first. Returns 0 (if there is not enough memory the lines are sorted then written all at once) */
+static int sort_incremental(char **lines,unsigned int n,bool numeric,int (*cmp)(const void *,const void *))
+{struct _incremental inc;
+ unsigned int i,k,nparts=n/INC_LINES_BLOCK,*start=NULL;
+ char **byrange=NULL;
+ memset(&inc,0,sizeof(inc));
+ inc.lines=lines;
+ inc.n=n;
+ inc.flush_at=1;
+ inc.start_t=clock();
+ if(cache_file!=NULL) inc.cache=cache_create(cache_file);
+ for(i=0;i<nheader;i++)
+ 	{fprintf(stdout,"%s\n",lineptr[i]);
+ 	 if(inc.cache!=NULL) fprintf(inc.cache,"%s\n",lineptr[i]);
+ 	}
+ fflush(stdout);
+ exact_nums=NULL;
+ if(numeric && (inc.items=malloc(n*sizeof(kitem_t)+1))!=NULL)
+ 	{if(exact_numbers && (exact_nums=malloc(n*sizeof(struct decnum)+1))==NULL)
+ 		{free(inc.items);
+ 		 inc.items=NULL; // not enough memory
+ 		}
+ 	 else if(for_lines_parallel(lines,n,numeric_items,inc.items)==0)
+ 	 	{free(inc.items);
+ 	 	 inc.items=NULL;
+ 	 	}
+ 	}
+ if(inc.items!=NULL)
+ 	incremental_sort_items(inc.items,n,emit_items,&inc);
+ else
+ 	{if(nparts>INC_LINES_PARTS) nparts=INC_LINES_PARTS;
+ 	 if(nparts>1 && (byrange=malloc(n*sizeof(char *)+1))!=NULL && (start=malloc((nparts+1)*sizeof(unsigned int)))!=NULL && split_by_range(lines,n,cmp,nparts,byrange,start))
+ 	 	{inc.lines=byrange;
+ 	 	 for(k=0;k<nparts;++k)
+ 	 	 	{qsort(byrange+start[k],start[k+1]-start[k],sizeof(char *),cmp);
+ 	 	 	 emit_lines(start[k+1],&inc);
+ 	 	 	}
+ 	 	}
+ 	 else
+ 	 	{qsort(lines,n,sizeof(char *),cmp);
+ 	 	 emit_lines(n,&inc);
+ 	 	}
+ 	}
+ free(inc.items);
+ free(byrange);
+ free(start);
+ free(exact_nums);
+ exact_nums=NULL;
+ cache_save(inc.cache,true);
+ if(verbose) fprintf(stderr,"nsort: sorted and written %u lines in %.3f secs\n",inc.written,(clock()-inc.start_t)/(double)(CLOCKS_PER_SEC));
+ return 0;
+}
+
+/* plain_integer: returns true if s (the start of the field being sorted on) is just an integer (no whitespace, + sign or leading zeros) with nothing after it on the line */
+/* lines where this is true that have the same number are identical, so do not need to be compared as strings */
+static bool plain_integer(const char *s)
+{if(*s=='-')
+ 	{++s;
+ 	 if(*s=='0') return false; // -0 is the same number as 0
+ 	}
+ if(*s=='0') return s[1]=='\0';
+ if(!isdigit(*s)) return false;
+ while(isdigit(*s)) ++s;
+ return *s=='\0';
+}
+
+struct _countkeys /* data for count_keys() */
+	{float *keys; // keys[i] is set to the number being sorted on for line i
+	 bool *plain; // plain[i] is set to plain_integer() for line i
+	};
+
+static void count_keys(void *arg) /* set keys for a block of lines for sort_counting(), can be run as a thread by for_lines_parallel() */
+{struct _lineblock *p=arg;
+ struct _countkeys *k=p->data;
+ unsigned int i;
+ numkeys(p->lines+p->from,p->to-p->from,k->keys+p->from);
+ for(i=p->from;i<p->to;++i)
+ 	k->plain[i]=plain_integer(key_field(p->lines[i]));
+}
+
+/* sort_counting: numerically sort lines[0..n-1] on the field set by --field N using a counting sort (--engine count) */
+/* this can only be used if all the numbers are integers in a range of less than COUNT_MAX_KEYS (lines that do not start with a number are fine, they all sort first) */
+/* the numbers are converted once (in parallel), the lines are counting sorted on them, then lines with the same number are sorted using sort_numeric_ties() so the result is the same as qsort() with mynCompare() */
+/* lines with the same number only need sorting if some of them are not plain integers (see plain_integer() ), as otherwise they are identical */
+/* returns 1 if the lines have been sorted, 0 if the numbers are not suitable, -1 if there is not enough memory (lines[] is unchanged if 0 or -1 is returned) */
+static int sort_counting(char **lines,unsigned int n)
+{float *keys=malloc(n*sizeof(float)+1);
+ bool *plain=malloc(n*sizeof(bool)+1);
+ struct _countkeys k;
+ kitem_t *items=NULL;
+ char **sorted=NULL;
+ float v,min=FLT_MAX,max= -FLT_MAX;
+ uint32_t nkeys=1; // key 0 is used for lines that do not start with a number
+ unsigned int i,j;
+ int result= -1;
+ k.keys=keys;
+ k.plain=plain;
+ if(keys==NULL || plain==NULL || for_lines_parallel(lines,n,count_keys,&k)==0)
+ 	goto done;
+ for(i=0;i<n;++i)
+ 	{v=keys[i];
+ 	 if(v== -FLT_MAX) continue; // not a number
+ 	 if(!(v>-16777216.0f && v<16777216.0f) || v!=(float)(int32_t)v)
+ 	 	{result=0; // not an integer (floats outside +/-2^24 are integers, but the range would be too big anyway)
+ 	 	 goto done;
+ 	 	}
+ 	 if(v<min) min=v;
+ 	 if(v>max) max=v;
+ 	}
+ if(min<=max)
+ 	{if(max-min+2>COUNT_MAX_KEYS)
+ 		{result=0; // range too big
+ 		 goto done;
+ 		}
+ 	 nkeys=(uint32_t)(max-min)+2;
+ 	}
+ items=malloc(n*sizeof(kitem_t)+1);
+ sorted=malloc(n*sizeof(char *)+1);
+ if(items==NULL || sorted==NULL)
+ 	goto done;
+ for(i=0;i<n;++i)
+ 	items[i]=KITEM(keys[i]== -FLT_MAX ? 0 : (uint32_t)(keys[i]-min)+1,i);
+ if(counting_sort_items(items,n,nkeys)<0)
+ 	goto done;
+ tie_body=lines;
+ for(i=0;i<n;i=j)
+ 	{bool all_plain=plain[KITEM_LINE(items[i])];
+ 	 for(j=i+1;j<n && KITEM_KEY(items[j])==KITEM_KEY(items[i]);++j) // find end of run with the same key
+ 	 	all_plain&=plain[KITEM_LINE(items[j])];
+ 	 if(!all_plain)
+ 	 	sort_numeric_ties(items+i,j-i);
+ 	}
+ for(i=0;i<n;++i)
+ 	sorted[i]=lines[KITEM_LINE(items[i])];
+ memcpy(lines,sorted,n*sizeof(char *));
+ result=1;
+done:
+ free(keys);
+ free(plain);
+ free(items);
+ free(sorted);
+ return result;
+}
+
+char *readline (FILE *fp)
+/* read next line from input and return a pointer to it. Returns NULL on EOF or error . Deletes \n from end of line */
+/* the same buffer is reused for the next input */
+/* no limit on the length of the line (except available RAM) */
+{int n;
+ char *cp;
+ int c=0;
+ char *new_buf;
+ unsigned int new_size;
+ if(buf_size==0)
+        {if((buf=(char *)malloc(FIRST_SIZE))==NULL )
+                return NULL; /* oops no space at all */
+         buf_size=FIRST_SIZE;
+        }
+ cp=buf;
+ n=buf_size;
+ while(1)
+        {while(--n && (c=getc(fp)) != EOF) /* while fits into existing buffer */
+                {if(c=='\n')
+                        {*cp='\0'; /* end of string */
+                         return buf;
+                        }
+                  *cp++=c;
+                 }
+         if(c==EOF)
+                return cp==buf ? NULL : buf; /* if we hit EOF then return last line if any */
+#if 1
+		 new_size= (buf_size | 1023) + 1021; // Increase the size of the buffer a "bit", rounds up to next multiple of 1024 and adds 1020. from an idea at https://stackoverflow.com/questions/43594181/using-parallel-arrays-in-c-to-sort-out-lines-of-data
+#else                
+         new_size=buf_size <<1; /* double size of buffer */
+#endif         
+         if((new_buf=(char *)realloc(buf,new_size))==NULL)
+                {/* realloc failed "eat" rest of line and return truncated line to caller */
+                 while((c=getc(fp)) != EOF && c!= '\n');
+                 *cp='\0';
+                 return buf;
+                }
+           else
+                { /* realloc went OK */
+                 cp=new_buf+(buf_size-1); /* reposition pointer into new buffer */
+                 n=new_size-buf_size+1; /* space left in new buffer (keeping 1 byte for the terminating '\0') */
+                 buf=new_buf;
+                 buf_size=new_size;
+                }
+        }
+/* NOT REACHED */
+}
+
+/* addline: add line p to lineptr[] */
+/* returns -1 on error (no space) , 0 if OK */
+static int addline(char *p)
+{
+	 if(lines_buf_size==0)
+	 	{// need to alocate initial spce for lineptr
+		 lineptr=calloc(FIRST_SIZE,sizeof(char *));
+		 if(lineptr==NULL) 
+		 	return -1; // no space
+		 lines_buf_size=FIRST_SIZE;
+		}
+	 else if(nlines>=lines_buf_size)	
+	 	{// need to increase the space to store lines
+#if 0
+		 lines_buf_size= (lines_buf_size | 1023) + 1021; // Increase the size of the buffer a "bit", rounds up to next multiple of 1024 and adds 1020. from an idea at https://stackoverflow.com/questions/43594181/using-parallel-arrays-in-c-to-sort-out-lines-of-data
+#else  	 	
+	 	 lines_buf_size <<=1 ; // double space
+#endif	 	 
+		 lineptr=realloc(lineptr,lines_buf_size*sizeof(char *));
+		 if(lineptr==NULL) 
+		 	return -1; // no space
+		}
+	 lineptr[nlines++] = p; // store line just read into array
+	 return 0;
+}
+
+/* readcsv: read a csv file from stdin. The whole file is read into one buffer, which is then split into records (which may contain newlines) by csv_split() */
+/* as records can contain newlines they cannot be written to runs by sort_external(), so if memory_budget>0 this stops reading as soon as the buffer would be bigger than it */
+/* returns -1 on error , -2 if the input is bigger than memory_budget, >=0 if OK */
+static int readcsv(void)
+{
+ char *csvbuf=NULL,*new_buf;
+ size_t csvbuf_size=1024*1024; // initial size, doubled when required
+ size_t len=0,n;
+ nlines = 0;
+ if((csvbuf=malloc(csvbuf_size))==NULL)
+ 	return -1;
+ while((n=fread(csvbuf+len,1,csvbuf_size-1-len,stdin))>0) // -1 leaves space for a terminating '\0'
+ 	{len+=n;
+ 	 if(len==csvbuf_size-1)
+ 	 	{// buffer full, make it bigger
+ 	 	 csvbuf_size<<=1;
+ 	 	 if(whole_input!=NULL && memory_budget>0 && csvbuf_size>memory_budget)
+ 	 	 	{free(csvbuf);
+ 	 	 	 return -2; // input too big for memory_budget
+ 	 	 	}
+ 	 	 if((new_buf=realloc(csvbuf,csvbuf_size))==NULL)
+ 	 	 	return -1; // no space
+ 	 	 csvbuf=new_buf;
+ 	 	}
+ 	}
+ if(cache_dir!=NULL)
+ 	cache_hash_add(&input_hash,csvbuf,len); // --cache-dir
+ if(csv_split(csvbuf,len,addline)<0)
+ 	return -1;
+ if(whole_input!=NULL && memory_budget>0 && len+1+(uint64_t)nlines*LINE_OVERHEAD>memory_budget)
+ 	return -2; // the records (with their pointers) use up memory_budget
+ if(sort_field>1 && nlines>0)
+ 	{// --field N: store the offset of the field in front of each record, so the compare routines do not scan every record from its start (allowing for quotes) each time
+ 	 size_t need=len+1+nlines*CSV_KEY_SIZE;
+ 	 char *p;
+ 	 unsigned int i;
+ 	 if(need>csvbuf_size && (new_buf=realloc(csvbuf,need))!=NULL)
+ 	 	{csvbuf=new_buf;
+ 	 	 csvbuf_size=need;
+ 	 	 for(p=csvbuf,i=0;i<nlines;++i) // the buffer may have moved, the records follow each other (each ends with a '\0') so can be found again
+ 	 	 	{lineptr[i]=p;
+ 	 	 	 p+=strlen(p)+1;
+ 	 	 	}
+ 	 	}
+ 	 if(need<=csvbuf_size) // otherwise there is not enough memory, so the fields are found by key_field() each time
+ 	 	{csv_key_offsets(lineptr,nlines,sort_field,true);
+ 	 	 csv_key_field=sort_field;
+ 	 	}
+ 	}
+ return nlines;
+}
+
+/* readlines: read input lines */
+/* returns -1 on error , -2 if the input is bigger than memory_budget and whole_input is set, >=0 if OK */
+/* no limit on the number of lines that can be read (except available RAM). */
+int readlines(void)
+{
+ if(csv_mode)
+ 	return readcsv(); // csv files are read in one go as records may span several lines
+ nlines = 0;
+ lines_memory = 0;
+ return readmore();
+}
+
+/* readmore: read input lines onto the end of lineptr[] */
+/* if memory_budget>0 this stops once the lines read use it up (after the header lines), setting more_input so the lines can be sorted as a run by sort_external() then this called again */
+/* returns -1 on error , -2 if the lines use up memory_budget and whole_input is set (so they cannot be sorted in runs), >=0 if OK */
+static int readmore(void)
+{
+ char *p,*l;
+ size_t len;
+ more_input=false;
+ while((l=readline(stdin))!= NULL)
+ 	{len=strlen(l);
+ 	 if(cache_dir!=NULL)
+ 		cache_hash_add(&input_hash,l,len); // --cache-dir, the hash is worked out as the lines are read so it needs no extra pass over the input
+	 if ((p = malloc(len+1)) == NULL)
+		return -1; // no space for a copy of the line just read in
+	 memcpy(p,l,len+1);
+	 if(addline(p)<0)
+	 	return -1;
+	 lines_memory+=len+1+LINE_OVERHEAD;
+	 if(memory_budget>0 && lines_memory>=memory_budget && nlines>header_lines)
+	 	{if(whole_input!=NULL) return -2; // fail now, rather than when memory runs out
+	 	 more_input=true; // the rest of the input is read after these lines have been sorted and written to a run
+	 	 break;
+	 	}
+	}
+ return nlines;
+}
+
+/* same_key: returns true if the sorted lines a and b have the same key, so only the string comparison of the rest of the lines decides their order */
+/* for numeric sorts the key is the number (compared in the same way as the sort does), for string sorts it is the field sorted on */
+static bool same_key(const char *a,const char *b,bool numeric)
+{const char *fa=key_field(a),*fb=key_field(b),*ea,*eb;
+ if(numeric)
+ 	{if(exact_numbers)
+ 		{struct decnum d1,d2;
+ 		 decnum_parse(&d1,num_start(fa));
+ 		 decnum_parse(&d2,num_start(fb));
+ 		 return decnum_cmp(&d1,&d2)==0;
+ 		}
+#ifdef  nsort_num_float
+ 	 if(!double_keys) return numkey(fa)==numkey(fb);
+#endif
+ 	 return dblkey(fa)==dblkey(fb);
+ 	}
+ ea=csv_field_end(fa,csv_mode);
+ eb=csv_field_end(fb,csv_mode);
+ return ea-fa==eb-fb && memcmp(fa,fb,(size_t)(ea-fa))==0;
+}
+
+static unsigned int key_boundary(char **body,unsigned int n,unsigned int b,bool numeric) /* move a boundary between output files at body[b] forwards so lines with the same key are not split between files */
+{while(b>0 && b<n && same_key(body[b-1],body[b],numeric)) ++b;
+ return b;
+}
+
+struct _splitpart /* part of the sorted lines written to its own file by write_part() */
+	{char **body; // lines to write
+	 unsigned int n; // number of lines
+	 char *filename; // file to write them to
+	 bool ok; // set to false if the file could not be written
+	};
+
+static void write_part(void *arg) /* write one file for --split-by-range or --split-size, can be run as a thread */
+{struct _splitpart *p=arg;
+ FILE *fp=fopen(p->filename,"w");
+ p->ok=false;
+ if(fp==NULL) return;
+ write_lines(fp,p->body,p->n);
+ p->ok= fclose(fp)==0;
+}
+
+/* write_split: write the sorted lines body[0..n-1] to the files PREFIX1.csv, PREFIX2.csv ... rather than stdout (--split-by-range N or --split-size SIZE) */
+/* each file holds a contiguous range of the sorted lines, with --split-by-range N there are N files with about the same number of lines (some may be empty if there are lots of lines with the same key),
+   with --split-size SIZE each file except the last has at least SIZE bytes of sorted lines (as few more as are needed to finish the lines with the same key) */
+/* lines with the same key (see same_key() ) are always written to the same file, and the header lines (--header N) are written to every file */
+/* the files are written in parallel threads (up to nos_threads() at once), returns 0 if OK or 1 on error */
+static int write_split(char **body,unsigned int n,bool numeric)
+{const char *prefix= out_prefix!=NULL ? out_prefix : "nsort_part";
+ unsigned int nparts,maxparts,k,t,from,b,nthreads=nos_threads();
+ struct _splitpart *parts;
+ thread_t *th;
+ bool *started,ok=true;
+ uint64_t bytes;
+ if(split_files>0)
+ 	maxparts=split_files;
+ else
+ 	{for(bytes=0,b=0;b<n;++b)
+ 		bytes+=strlen(body[b])+1; // +1 for the newline
+ 	 maxparts= bytes/split_size<n ? (unsigned int)(bytes/split_size)+1 : n+1; // every file but the last has at least split_size bytes
+ 	}
+ if(nthreads<1) nthreads=1;
+ parts=calloc(maxparts,sizeof(struct _splitpart));
+ th=calloc(nthreads,sizeof(thread_t));
+ started=calloc(nthreads,sizeof(bool));
+ if(parts==NULL || th==NULL || started==NULL)
+ 	{fprintf(stderr,"nsort: out of memory\n");
+ 	 free(parts);
+ 	 free(th);
+ 	 free(started);
+ 	 return 1;
+ 	}
+ for(nparts=0,from=0;nparts<maxparts && (split_files>0 || from<n || nparts==0);++nparts) // --split-by-range always writes split_files files
+ 	{if(split_files>0)
+ 		{b=(unsigned int)(((uint64_t)n*(nparts+1))/split_files);
+ 		 if(b<from) b=from; // the previous file took extra lines with the same key
+ 		}
+ 	 else
+ 	 	for(bytes=0,b=from;b<n && bytes<split_size;++b)
+ 	 		bytes+=strlen(body[b])+1;
+ 	 if(nparts+1==maxparts) b=n; // last file possible takes the rest of the lines
+ 	 b=key_boundary(body,n,b,numeric);
+ 	 parts[nparts].body=body+from;
+ 	 parts[nparts].n=b-from;
+ 	 if((parts[nparts].filename=malloc(strlen(prefix)+20))==NULL)
+ 	 	{fprintf(stderr,"nsort: out of memory\n");
+ 	 	 ok=false;
+ 	 	 break;
+ 	 	}
+ 	 sprintf(parts[nparts].filename,"%s%u.csv",prefix,nparts+1);
+ 	 from=b;
+ 	}
+ if(ok && verbose) fprintf(stderr,"nsort: writing %u file(s) %s1.csv to %s%u.csv using up to %u thread(s)\n",nparts,prefix,prefix,nparts,nthreads);
+ for(k=0;ok && k<nparts;k+=nthreads)
+ 	{// write the files nthreads at a time, each in its own thread
+ 	 for(t=0;t<nthreads && k+t<nparts;++t)
+ 	 	{if(t+1<nthreads && k+t+1<nparts && thread_start(&th[t],write_part,&parts[k+t]))
+ 	 	 	started[t]=true;
+ 	 	 else
+ 	 	 	{started[t]=false;
+ 	 	 	 write_part(&parts[k+t]); // last file of this group (or if the thread could not be started) is written here
+ 	 	 	}
+ 	 	}
+ 	 for(t=0;t<nthreads && k+t<nparts;++t)
+ 	 	{if(started[t]) thread_join(th[t]);
+ 	 	 if(!parts[k+t].ok)
+ 	 	 	{fprintf(stderr,"nsort: error writing output file %s\n",parts[k+t].filename);
+ 	 	 	 ok=false;
+ 	 	 	}
+ 	 	}
+ 	}
+ for(k=0;k<nparts;++k)
+ 	free(parts[k].filename);
+ free(parts);
+ free(th);
+ free(started);
+ return ok ? 0 : 1;
+}
+
+#define MAX_WORKERS 256 /* max value for --workers N */
+#define MAX_THREADS 1024 /* max value for -j N */
+#define WORKER_COPY_SIZE 65536 /* size of buffer used to copy the output of a worker to stdout */
+
+struct _workerinput /* lines to be written to a worker by feed_worker() */
+	{struct worker *w;
+	 char **lines;
+	 unsigned int n;
+	 bool ok; // set to false if the lines could not all be written
+	};
+
+static void feed_worker(void *arg) /* write the lines for a worker to its stdin, then close it so the worker knows it has all its lines, can be run as a thread */
+{struct _workerinput *p=arg;
+ unsigned int i;
+ bool ok=true;
+ for(i=0;i<p->n && ok;++i)
+ 	ok= fputs(p->lines[i],p->w->in)>=0 && putc('\n',p->w->in)!=EOF;
+ p->ok= fclose(p->w->in)==0 && ok;
+}
+
+/* sort_by_workers: sort lines body[0..n-1] using nos_workers copies of this program as worker processes and write the result to stdout (--workers N) */
+/* the ranges of keys each worker sorts are chosen from a sorted sample of the lines (see split_by_range() ), each line is sent to the worker for its range
+   (lines that compare equal always go to the same worker so -u still works).
+   The workers sort their lines in parallel, and as the ranges do not overlap their outputs are just copied to stdout one after the other.
+   The lines sent to a worker and its output are both a "run" of lines each ending in '\n' (exactly what nsort reads and writes),
+   so a worker could be any program that sorts its stdin to stdout in the same way (eg on another computer).
+*/
+/* returns 0 if OK, 1 on error, or -1 if the workers could not be started (in which case nothing has been written and the lines are unchanged) */
+static int sort_by_workers(char **body,unsigned int n,int (*cmp)(const void *,const void *))
+{unsigned int nw=nos_workers,i,k,*count;
+ char **byrange=NULL,*buf=NULL;
+ FILE *cf=NULL; // copy of the output to be saved in the cache (--cache-dir DIR)
+ struct worker *w=NULL;
+ struct _workerinput *in=NULL;
+ thread_t *th=NULL;
+ bool *started=NULL;
+ int ret=0;
+ size_t len;
+ clock_t start_t=clock(),end_t;
+ byrange=malloc(n*sizeof(char *)+1);
+ count=calloc(nw+1,sizeof(unsigned int));
+ w=calloc(nw,sizeof(struct worker));
+ in=calloc(nw,sizeof(struct _workerinput));
+ th=calloc(nw,sizeof(thread_t));
+ started=calloc(nw,sizeof(bool));
+ buf=malloc(WORKER_COPY_SIZE);
+ if(byrange==NULL || count==NULL || w==NULL || in==NULL || th==NULL || started==NULL || buf==NULL || !split_by_range(body,n,cmp,nw,byrange,count))
+ 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 ret=1;
+ 	 goto done;
+ 	}
+ for(k=0;k<nw;++k)
+ 	{in[k].w=&w[k];
+ 	 in[k].lines=byrange+count[k];
+ 	 in[k].n=count[k+1]-count[k];
+ 	}
+ for(k=0;k<nw;++k)
+ 	if(!worker_start(&w[k],worker_argv))
+ 		{while(k-->0)
+ 			{fclose(w[k].in);
+ 			 worker_wait(&w[k]);
+ 			}
+ 		 ret= -1;
+ 		 goto done;
+ 		}
+ if(verbose)
+ 	{end_t=clock();
+ 	 fprintf(stderr,"nsort: %u worker(s) started in %.3f secs, lines for each:",nw,(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 	 for(k=0;k<nw;++k)
+ 	 	fprintf(stderr," %u",in[k].n);
+ 	 fprintf(stderr,"\n");
+ 	}
+ for(k=0;k<nw;++k)
+ 	{// each worker is sent its lines by its own thread, so the workers all start sorting as soon as possible
+ 	 if(thread_start(&th[k],feed_worker,&in[k]))
+ 	 	started[k]=true;
+ 	 else
+ 	 	feed_worker(&in[k]); // a worker only writes its output once it has read all its input, so this cannot get stuck
+ 	}
+ if(cache_file!=NULL) cf=cache_create(cache_file);
+ for(i=0;i<nheader;++i)
+ 	{printf("%s\n",lineptr[i]);
+ 	 if(cf!=NULL) fprintf(cf,"%s\n",lineptr[i]);
+ 	}
+ for(k=0;k<nw;++k)
+ 	{// copy the output of each worker to stdout in turn
+ 	 while((len=fread(buf,1,WORKER_COPY_SIZE,w[k].out))>0)
+ 	 	{if(fwrite(buf,1,len,stdout)!=len) ret=1;
+ 	 	 if(cf!=NULL) fwrite(buf,1,len,cf);
+ 	 	}
+ 	 if(started[k]) thread_join(th[k]);
+ 	 if(worker_wait(&w[k])!=0 || !in[k].ok)
+ 	 	{fprintf(stderr,"nsort: worker %u failed\n",k+1);
+ 	 	 ret=1;
+ 	 	}
+ 	}
+ if(verbose)
+ 	{end_t=clock();
+ 	 fprintf(stderr,"nsort: workers finished and output written in %.3f secs\n",(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 	}
+ cache_save(cf,ret==0); // the output is only saved if all the workers succeeded
+done:
+ free(byrange);
+ free(count);
+ free(w);
+ free(in);
+ free(th);
+ free(started);
+ free(buf);
+ return ret;
+}
+
+/* sort_lines: sort lines body[0..n-1] using the engine set by --engine NAME, or if that is auto the one plan_engine() chooses from a sample of the lines */
+/* if the engine cannot be used (eg it is for numeric sorts only, or there is not enough memory for it) qsort() is used */
+static void sort_lines(char **body,unsigned int n,bool numeric,int (*cmp)(const void*,const void*))
+{enum sort_engine e=engine;
+ if(e==ENGINE_AUTO || verbose)
+ 	{// measure a sample of the input to choose the engine
+ 	 struct sort_stats stats;
+ 	 struct plan_params params;
+ 	 params.cmp=cmp;
+ 	 params.numkey= numeric ? linekey : NULL;
+ 	 params.field=sort_field;
+ 	 params.quoted=csv_mode;
+ 	 plan_sample(&stats,body,n,&params); // if this runs out of memory stats are set as for random input, which is fine to plan with
+ 	 if(e==ENGINE_AUTO) e=plan_engine(&stats,numeric);
+ 	 if(verbose) plan_print(stderr,&stats,e);
+ 	}
+ if(((e==ENGINE_RADIX || e==ENGINE_COUNT || e==ENGINE_DPQ || e==ENGINE_VQS || e==ENGINE_FLAG) && !numeric) || ((e==ENGINE_DICT || e==ENGINE_LCP || e==ENGINE_BURST || e==ENGINE_MSD) && numeric))
+ 	{if(verbose) fprintf(stderr,"nsort: --engine %s cannot be used for a %s sort, using qsort\n",engine_name(e),numeric ? "numeric" : "string");
+ 	 e=ENGINE_QSORT;
+ 	}
+ if((e==ENGINE_LCP || e==ENGINE_BURST || e==ENGINE_MSD) && sort_field>1)
+ 	{if(verbose) fprintf(stderr,"nsort: --engine %s can only sort whole lines (not with --field), using qsort\n",engine_name(e));
+ 	 e=ENGINE_QSORT;
+ 	}
+ if(e==ENGINE_COUNT && exact_numbers)
+ 	{if(verbose) fprintf(stderr,"nsort: --engine count converts numbers to floats so cannot be used with --exact, using radix sort\n");
+ 	 e=ENGINE_RADIX;
+ 	}
+ switch(e)
+ 	{case ENGINE_DICT: // if there are too many different keys fall back to qsort()
+ 		{unsigned int max_keys=n/DICT_MIN_LINES_PER_KEY;
+ 		 if(max_keys>DICT_MAX_KEYS) max_keys=DICT_MAX_KEYS;
+ 		 if(dict_sort(body,n,sort_field,csv_mode,max_keys)==0)
+ 		 	{if(verbose) fprintf(stderr,"nsort: sorted using a dictionary of %u different keys\n",dict_keys());
+ 		 	 break;
+ 		 	}
+ 		 if(verbose) fprintf(stderr,"nsort: too many different keys for a dictionary (max %u), using qsort\n",max_keys);
+ 		 e=ENGINE_QSORT;
+ 		 break;
+ 		}
+ 	 case ENGINE_LCP:
+ 	 	if(lcp_mergesort(body,n)==0) break;
+ 	 	if(verbose) fprintf(stderr,"nsort: not enough memory for LCP merge sort, using qsort\n");
+ 	 	e=ENGINE_QSORT;
+ 	 	break;
+ 	 case ENGINE_BURST:
+ 	 	if(burstsort(body,n)==0) break;
+ 	 	if(verbose) fprintf(stderr,"nsort: not enough memory for burstsort, using qsort\n");
+ 	 	e=ENGINE_QSORT;
+ 	 	break;
+ 	 case ENGINE_MSD:
+ 	 	if(msd_radixsort(body,n)==0) break;
+ 	 	if(verbose) fprintf(stderr,"nsort: not enough memory for MSD radix sort, using qsort\n");
+ 	 	e=ENGINE_QSORT;
+ 	 	break;
+ 	 case ENGINE_MERGE:
+ 	 	if(mergesort(body,n,sizeof(char *),cmp)==0) break;
+ 	 	if(verbose) fprintf(stderr,"nsort: not enough memory for merge sort, using qsort\n");
+ 	 	e=ENGINE_QSORT;
+ 	 	break;
+ 	 case ENGINE_COUNT: // if the numbers are not small integers fall back to a radix sort
+ 	 	{int r=sort_counting(body,n);
+ 	 	 if(r>0) break;
+ 	 	 if(r<0)
+ 	 	 	{if(verbose) fprintf(stderr,"nsort: not enough memory for counting sort, using qsort\n");
+ 	 	 	 e=ENGINE_QSORT;
+ 	 	 	 break;
+ 	 	 	}
+ 	 	 if(verbose) fprintf(stderr,"nsort: numbers are not integers in a small enough range for a counting sort, using radix sort\n");
+ 	 	 e=ENGINE_RADIX;
+ 	 	}
+ 	 	// falls through
+ 	 case ENGINE_RADIX:
+ 	 	if(sort_numeric(body,n,radix_sort_items)) break;
+ 	 	if(verbose) fprintf(stderr,"nsort: not enough memory for radix sort, using qsort\n");
+ 	 	e=ENGINE_QSORT;
+ 	 	break;
+ 	 case ENGINE_DPQ:
+ 	 	if(sort_numeric(body,n,quicksort_items)) break;
+ 	 	if(verbose) fprintf(stderr,"nsort: not enough memory for dual-pivot quicksort, using qsort\n");
+ 	 	e=ENGINE_QSORT;
+ 	 	break;
+ 	 case ENGINE_VQS:
+ 	 	if(sort_numeric(body,n,vquicksort_items)) break;
+ 	 	if(verbose) fprintf(stderr,"nsort: not enough memory for vectorised quicksort, using qsort\n");
+ 	 	e=ENGINE_QSORT;
+ 	 	break;
+ 	 case ENGINE_FLAG:
+ 	 	if(sort_numeric(body,n,flag_sort_items)) break;
+ 	 	if(verbose) fprintf(stderr,"nsort: not enough memory for American flag sort, using qsort\n");
+ 	 	e=ENGINE_QSORT;
+ 	 	break;
+ 	 default:
+ 	 	break;
+ 	}
+ if(e==ENGINE_QSORT)
+ 	{qsort(body,n,sizeof(char *),cmp); /* actually do the sort */
+ 	}
+}
+
+/* external sort: when the input uses up memory_budget (so would not fit into memory, or would get this process killed in a container) the lines read so far are sorted (with sort_lines() )
+   and written to a temporary file as a "run" of '\n' terminated lines (the same as the output, and what --workers N sends to and gets from its workers), then their memory is freed and more lines are read.
+   The last run is kept in memory, then all the runs are merged (using a heap of the current line of each run) to stdout. */
+struct _run /* a sorted run of lines for sort_external() */
+	{FILE *fp; // temporary file holding the run, NULL for the last run which is in memory
+	 char *line; // current line of the run
+	 char *buf; // buffer for lines read from fp
+	 size_t size; // size of buf
+	 char **lines; // last run: the lines
+	 unsigned int next,n; // last run: lines[next] is the next line, lines[n-1] the last
+	};
+
+static bool run_next(struct _run *r) /* move on to the next line of run r, returns false at the end of the run */
+{size_t len=0;
+ char *new_buf;
+ if(r->fp==NULL)
+ 	{if(r->next>=r->n) return false;
+ 	 r->line=r->lines[r->next++];
+ 	 return true;
+ 	}
+ for(;;)
+ 	{if(len+2>r->size) // make space for at least one more character and the '\0'
+ 		{r->size= r->size==0 ? FIRST_SIZE : 2*r->size;
+ 		 if((new_buf=realloc(r->buf,r->size))==NULL) return false;
+ 		 r->buf=new_buf;
+ 		}
+ 	 if(fgets(r->buf+len,(int)(r->size-len),r->fp)==NULL)
+ 	 	{if(len==0) return false; // end of run
+ 	 	 break;
+ 	 	}
+ 	 len+=strlen(r->buf+len);
+ 	 if(len>0 && r->buf[len-1]=='\n')
+ 	 	{r->buf[--len]='\0';
+ 	 	 break;
+ 	 	}
+ 	}
+ r->line=r->buf;
+ return true;
+}
+
+static struct _run *merge_runs; /* runs being merged by sort_external() */
+static int (*merge_cmp)(const void *,const void *); /* compare routine for the sort, used by sort_external() */
+
+static inline bool run_less(unsigned int a,unsigned int b) /* true if the current line of run a sorts before the current line of run b, lines that compare equal come from the earlier run first */
+{int c=merge_cmp(&merge_runs[a].line,&merge_runs[b].line);
+ return c<0 || (c==0 && a<b);
+}
+
+static void run_sift_down(unsigned int *heap,unsigned int n,unsigned int i) /* move heap[i] down to its place in heap[0..n-1] */
+{unsigned int child,x=heap[i];
+ while((child=2*i+1)<n)
+ 	{if(child+1<n && run_less(heap[child+1],heap[child])) ++child;
+ 	 if(!run_less(heap[child],x)) break;
+ 	 heap[i]=heap[child];
+ 	 i=child;
+ 	}
+ heap[i]=x;
+}
+
+/* sort_external: sort the input as runs that each fit within memory_budget then merge them to stdout, called when readlines() stopped with more_input set */
+/* returns 0 if OK, 1 on error */
+static int sort_external(bool numeric,int (*cmp)(const void *,const void *))
+{struct _run *runs=NULL,*new_runs;
+ unsigned int nruns=0,size=0,i,k,n,*heap=NULL,nheap=0;
+ char **body=lineptr+nheader,*last=NULL;
+ size_t last_size=0,len;
+ int ret=1;
+ clock_t start_t=clock();
+ for(;;)
+ 	{n=nlines-nheader;
+ 	 sort_lines(body,n,numeric,cmp);
+ 	 if(nruns>=size)
+ 	 	{size= size==0 ? 16 : 2*size;
+ 	 	 if((new_runs=realloc(runs,size*sizeof(struct _run)))==NULL)
+ 	 	 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 	 	 goto done;
+ 	 	 	}
+ 	 	 runs=new_runs;
+ 	 	}
+ 	 memset(&runs[nruns],0,sizeof(struct _run));
+ 	 if(!more_input)
+ 	 	{runs[nruns].lines=body; // the last run stays in memory
+ 	 	 runs[nruns++].n=n;
+ 	 	 break;
+ 	 	}
+ 	 if((runs[nruns].fp=tmpfile())==NULL)
+ 	 	{fprintf(stderr,"nsort: error cannot create a temporary file for run %u of the external sort\n",nruns+1);
+ 	 	 goto done;
+ 	 	}
+ 	 for(i=0;i<n;++i)
+ 	 	{if(!do_uniq || i==0 || strcmp(body[i-1],body[i])) // as write_lines()
+ 	 		{fputs(body[i],runs[nruns].fp);
+ 	 		 putc('\n',runs[nruns].fp);
+ 	 		}
+ 	 	}
+ 	 for(i=0;i<n;++i)
+ 	 	free(body[i]);
+ 	 if(fflush(runs[nruns].fp)!=0 || ferror(runs[nruns].fp))
+ 	 	{fprintf(stderr,"nsort: error writing run %u of the external sort to a temporary file\n",nruns+1);
+ 	 	 ++nruns;
+ 	 	 goto done;
+ 	 	}
+ 	 rewind(runs[nruns].fp);
+ 	 ++nruns;
+ 	 if(verbose) fprintf(stderr,"nsort: run %u of %u lines sorted and written to a temporary file\n",nruns,n);
+ 	 nlines=nheader;
+ 	 lines_memory=0;
+ 	 if(readmore()<0)
+ 	 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 	 goto done;
+ 	 	}
+ 	}
+ if((heap=malloc(nruns*sizeof(unsigned int)))==NULL)
+ 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 goto done;
+ 	}
+ for(i=0;i<nheader;i++)
+ 	fprintf(stdout,"%s\n",lineptr[i]);
+ merge_runs=runs;
+ merge_cmp=cmp;
+ for(k=0;k<nruns;++k)
+ 	if(run_next(&runs[k]))
+ 		heap[nheap++]=k;
+ for(i=nheap/2;i-->0;)
+ 	run_sift_down(heap,nheap,i);
+ while(nheap>0)
+ 	{struct _run *r=&runs[heap[0]];
+ 	 if(!do_uniq || last==NULL || strcmp(last,r->line))
+ 	 	{fputs(r->line,stdout);
+ 	 	 putchar('\n');
+ 	 	 if(do_uniq)
+ 	 	 	{// save a copy of the line for -u, as the buffer it is in is reused for the next line of the run
+ 	 	 	 len=strlen(r->line)+1;
+ 	 	 	 if(len>last_size)
+ 	 	 	 	{free(last);
+ 	 	 	 	 if((last=malloc(last_size=2*len))==NULL) last_size=0;
+ 	 	 	 	}
+ 	 	 	 if(last!=NULL) memcpy(last,r->line,len);
+ 	 	 	}
+ 	 	}
+ 	 if(!run_next(r))
+ 	 	heap[0]=heap[--nheap]; // end of this run
+ 	 run_sift_down(heap,nheap,0);
+ 	}
+ ret=0;
+ for(k=0;k<nruns;++k)
+ 	if(runs[k].fp!=NULL && ferror(runs[k].fp))
+ 		{fprintf(stderr,"nsort: error reading run %u of the external sort from a temporary file\n",k+1);
+ 		 ret=1;
+ 		}
+ if(verbose) fprintf(stderr,"nsort: external sort of %u runs took %.3f secs\n",nruns,(clock()-start_t)/(double)(CLOCKS_PER_SEC));
+done:
+ for(k=0;k<nruns;++k)
+ 	{if(runs[k].fp!=NULL) fclose(runs[k].fp); // temporary files from tmpfile() are deleted when they are closed
+ 	 free(runs[k].buf);
+ 	}
+ free(runs);
+ free(heap);
+ free(last);
+ return ret;
+}
+
+/* cached_output: for --cache-dir DIR, if the output for this input sorted with the same options is in the cache copy it to stdout and return true */
+/* otherwise set cache_file so writelines() saves the output in the cache, and return false */
+/* the options that change the output (and the version of nsort) are described by a string, which is hashed as part of the name of the cache file */
+static bool cached_output(bool numeric)
+{FILE *fp;
+ char *options;
+ int len;
+ const char *fmt="nsort %s n=%d q=%d u=%d c=%d field=%u header=%u exact=%d double=%d engine=%d expr=%s";
+ len=snprintf(NULL,0,fmt,VERSION,numeric,quoted_numbers,do_uniq,csv_mode,sort_field,header_lines,exact_numbers,double_keys,(int)engine,key_expr_text);
+ if(len<0 || (options=malloc(len+1))==NULL) return false;
+ snprintf(options,len+1,fmt,VERSION,numeric,quoted_numbers,do_uniq,csv_mode,sort_field,header_lines,exact_numbers,double_keys,(int)engine,key_expr_text);
+ cache_file=cache_path(cache_dir,&input_hash,options);
+ free(options);
+ if(cache_file==NULL || (fp=cache_open(cache_file))==NULL)
+ 	{if(verbose && cache_file!=NULL) fprintf(stderr,"nsort: output is not in the cache, it will be saved as %s\n",cache_file);
+ 	 return false;
+ 	}
+ if(!cache_copy(fp,stdout))
+ 	fprintf(stderr,"nsort: error copying the output from the cache file %s\n",cache_file);
+ fclose(fp);
+ if(verbose) fprintf(stderr,"nsort: output copied from the cache file %s\n",cache_file);
+ return true;
+}
+
+/* option_value: read the value (an unsigned integer in the range min..max) for long option opt, which is the next argument on the command line */
+/* returns false if there is no value or it is not valid, otherwise *argc and *argv are updated to skip over the value */
+static bool option_value(int *argc,char ***argv,const char *opt,unsigned long min,unsigned long max,unsigned long *v)
+{char *end;
+ if(*argc<=1)
+ 	{fprintf(stderr,"nsort: --%s needs a value\n",opt);
+ 	 return false;
+ 	}
+ --*argc;
+ ++*argv;
+ *v=strtoul(**argv,&end,10);
+ if(end==**argv || *end!='\0' || *v<min || *v>max)
+ 	{fprintf(stderr,"nsort: invalid value \"%s\" for --%s (must be between %lu and %lu)\n",**argv,opt,min,max);
+ 	 return false;
+ 	}
+ return true;
+}
+
+/* size_value: read a size in bytes (a number optionally followed by k, M or G for KiB, MiB or GiB) for long option opt, which is the next argument on the command line */
+/* returns false if there is no value or it is not valid (or is 0), otherwise *argc and *argv are updated to skip over the value */
+static bool size_value(int *argc,char ***argv,const char *opt,uint64_t *v)
+{char *end;
+ unsigned int shift=0;
+ if(*argc<=1)
+ 	{fprintf(stderr,"nsort: --%s needs a value\n",opt);
+ 	 return false;
+ 	}
+ --*argc;
+ ++*argv;
+ *v=strtoull(**argv,&end,10);
+ switch(*end)
+ 	{case 'k': case 'K': shift=10; ++end; break;
+ 	 case 'm': case 'M': shift=20; ++end; break;
+ 	 case 'g': case 'G': shift=30; ++end; break;
+ 	}
+ if(end==**argv || !isdigit((unsigned char)***argv) || *end!='\0' || *v==0 || *v>(UINT64_MAX>>shift))
+ 	{fprintf(stderr,"nsort: invalid value \"%s\" for --%s (must be a number of bytes, optionally followed by k, M or G)\n",**argv,opt);
+ 	 return false;
+ 	}
+ *v<<=shift;
+ return true;
+}
+
+struct _exprparams /* data for eval_expr() */
+	{double *values; // values[i] is set to the value of the expression for line i
+	 kitem_t *items; // items[i] is set to the sort item for line i
+	};
+
+static void eval_expr(void *arg) /* evaluate key_expr for a block of lines, can be run as a thread by for_lines_parallel() */
+{struct _lineblock *p=arg;
+ struct _exprparams *e=p->data;
+ unsigned int i;
+ double v;
+ for(i=p->from;i<p->to;++i)
+ 	{if(!keyexpr_eval(key_expr,p->lines[i],csv_mode,&v))
+ 		v= -DBL_MAX; // very large negative number if a field is not a number so sorts first
+ 	 e->values[i]=v;
+ 	 e->items[i]=KITEM(float_key((float)v),i);
+ 	}
+}
+
+static double *expr_values; /* values of the expression for each line being sorted by sort_by_expr() */
+static char **expr_body; /* lines being sorted by sort_by_expr() */
+static int exprTieCompare(uint32_t l1,uint32_t l2) /* compare lines with the same float key, used by sort_by_expr() */
+{if(expr_values[l1]<expr_values[l2]) return -1;
+ if(expr_values[l1]>expr_values[l2]) return 1;
+ return strcmp(expr_body[l1],expr_body[l2]); // identical values so sort as strings
+}
+
+/* sort_by_expr: numerically sort lines on the value of key_expr (--key-expr EXPR) */
+/* The expression is evaluated once for each line (in parallel), then the lines are radix sorted on the value as a float, lines with the same float are then sorted on the full value then as strings */
+/* returns 0 if OK, 1 on error */
+static int sort_by_expr(void)
+{unsigned int n=nlines-nheader; // lines to sort
+ unsigned int i,nthreads;
+ struct _exprparams e;
+ char **sorted=malloc(n*sizeof(char *)+1);
+ clock_t start_t,end_t;
+ start_t=clock();
+ expr_body=lineptr+nheader;
+ e.values=expr_values=malloc(n*sizeof(double)+1);
+ e.items=malloc(n*sizeof(kitem_t)+1);
+ if(sorted==NULL || e.values==NULL || e.items==NULL || (nthreads=for_lines_parallel(expr_body,n,eval_expr,&e))==0)
+ 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 return 1;
+ 	}
+ if(verbose)
+ 	{end_t=clock();
+ 	 fprintf(stderr,"nsort: expression evaluated for all lines using %u thread(s) in %.3f secs\n",nthreads,(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 	 start_t=clock();
+ 	}
+ if(radix_sort_items(e.items,n)<0)
+ 	{fprintf(stderr,"nsort: error input too big to sort\n");
+ 	 return 1;
+ 	}
+ sort_ties(e.items,n,exprTieCompare);
+ for(i=0;i<n;++i)
+ 	sorted[i]=expr_body[KITEM_LINE(e.items[i])];
+ if(verbose)
+ 	{end_t=clock();
+ 	 fprintf(stderr,"nsort: sort took %.3f secs\n",(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 	 start_t=clock();
+ 	}
+ writelines(stdout,sorted);
+ if(verbose)
+ 	{end_t=clock();
+ 	 fprintf(stderr,"nsort: output written in %.3f secs\n",(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 	}
+ return 0;
+}
+
+/* --window N and --window-key D: sort a stream that is already nearly in order (eg events that arrive up to a few seconds late) using bounded memory */
+/* lines wait in a heap (smallest at the top) and the smallest is output when there are more than N lines waiting, or when a number more than D bigger than its number has been read */
+#define WINDOW_FIRST_SIZE 1024 /* initial size of the heap for sort_window(), it is doubled when required */
+
+struct _pending /* a line waiting to be output by sort_window() */
+	{uint32_t key; // order preserving key (float_key() or decnum_key() of the number sorted on for numeric sorts, 0 for string sorts), lines with the same key are compared with window_cmp()
+	 double value; // numeric sorts: the number sorted on as a double (for --window-key), a float cannot tell apart numbers such as timestamps in seconds that are close together
+	 struct decnum num; // --exact: the number sorted on (for --window-key)
+	 char *line;
+	};
+
+static int (*window_cmp)(const void *,const void *); /* compare routine for the sort, used by sort_window() */
+
+static inline bool pending_less(const struct _pending *a,const struct _pending *b)
+{return a->key<b->key || (a->key==b->key && window_cmp(&a->line,&b->line)<0);
+}
+
+static void heap_push(struct _pending *heap,size_t n,struct _pending x) /* add x to heap[0..n-1] (heap[n] must be available) */
+{size_t i=n,parent;
+ while(i>0 && pending_less(&x,&heap[parent=(i-1)/2]))
+ 	{heap[i]=heap[parent];
+ 	 i=parent;
+ 	}
+ heap[i]=x;
+}
+
+static struct _pending heap_pop(struct _pending *heap,size_t n) /* remove and return the smallest of heap[0..n-1] (n>0) */
+{struct _pending top=heap[0],x=heap[--n];
+ size_t i=0,child;
+ while((child=2*i+1)<n)
+ 	{if(child+1<n && pending_less(&heap[child+1],&heap[child])) ++child;
+ 	 if(!pending_less(&heap[child],&x)) break;
+ 	 heap[i]=heap[child];
+ 	 i=child;
+ 	}
+ heap[i]=x;
+ return top;
+}
+
+static void window_write(struct _pending *x,struct _pending *last) /* output line x->line, last is the line output before it (for -u) which is freed */
+{if(do_uniq && last->line!=NULL && strcmp(last->line,x->line)==0)
+ 	{free(x->line); // same as the last line output
+ 	 return;
+ 	}
+ fputs(x->line,stdout);
+ putchar('\n');
+ free(last->line);
+ *last= *x;
+}
+
+/* window_release: returns true if line x (the smallest waiting) is more than window_key smaller than the biggest number read so far (max, or max_num for --exact) so can be output */
+static inline bool window_release(const struct _pending *x,double max,const struct decnum *max_num,const struct decnum *key_num)
+{if(exact_numbers)
+ 	return x->num.sign==DECNUM_NAN || (max_num->sign!=DECNUM_NAN && decnum_cmp_diff(&x->num,max_num,key_num)>0); // exact, however many digits the numbers have
+ return x->value<max-window_key;
+}
+
+/* sort_window: read lines from stdin and write them to stdout in sorted order, as long as no line arrives more than the window (--window N and/or --window-key D) after lines that sort after it */
+/* lines that do arrive too late are output as soon as possible (so are out of order) and counted (-v prints the count). Memory used is bounded by the window, so the input can be an endless stream.
+   The numbers are converted once per line (with numkey(), or decnum_key() for --exact), and lines with the same key are compared as the sort does so the order is the same as the full sort.
+   If stdin is not a file (eg a pipe) stdout is flushed each time lines are output so they are not held back in its buffer. Returns 0 if OK, 1 on error */
+static int sort_window(bool numeric)
+{struct _pending *heap=NULL,*new_heap,x,last;
+ size_t nheap=0,heap_size=0;
+ char *l;
+ unsigned int nread=0,late=0;
+ double max_value= -DBL_MAX;
+ struct decnum max_num,key_num;
+ char *max_text=NULL; // --exact: copy of the biggest number read so far (max_num describes this), as the line it came from may be output and freed
+ size_t max_size=0,len;
+ bool output,flush=true;
+ struct stat st;
+ clock_t start_t=clock();
+ window_cmp= numeric ? (exact_numbers ? myxCompare : double_keys ? mydCompare : mynCompare) : mysCompare;
+ if(fstat(0,&st)==0 && S_ISREG(st.st_mode))
+ 	flush=false; // stdin is a file so it is not waiting for more input, just let stdout buffer as normal
+ memset(&last,0,sizeof(last));
+ decnum_parse(&max_num,""); // not a number, so nothing is output by the key window until a number has been read
+ decnum_parse(&key_num,window_key_text);
+ while((l=readline(stdin))!=NULL)
+ 	{if(nread++<header_lines)
+ 		{fprintf(stdout,"%s\n",l); // header lines are output as they are read
+ 		 if(flush) fflush(stdout);
+ 		 continue;
+ 		}
+ 	 if(nheap>=heap_size)
+ 	 	{heap_size= heap_size==0 ? WINDOW_FIRST_SIZE : 2*heap_size;
+ 	 	 if((new_heap=realloc(heap,heap_size*sizeof(struct _pending)))==NULL)
+ 	 	 	{fprintf(stderr,"nsort: error window too big\n");
+ 	 	 	 return 1;
+ 	 	 	}
+ 	 	 heap=new_heap;
+ 	 	}
+ 	 if((x.line=strdup(l))==NULL)
+ 	 	{fprintf(stderr,"nsort: error window too big\n");
+ 	 	 return 1;
+ 	 	}
+ 	 x.key=0;
+ 	 x.value= -DBL_MAX;
+ 	 if(numeric)
+ 	 	{if(exact_numbers)
+ 	 	 	{decnum_parse(&x.num,num_start(key_field(x.line)));
+ 	 	 	 x.key=decnum_key(&x.num);
+ 	 	 	 if(window_by_key && x.num.sign!=DECNUM_NAN && decnum_cmp(&x.num,&max_num)>0)
+ 	 	 	 	{// new biggest number, save a copy of it
+ 	 	 	 	 const char *s=num_start(key_field(x.line));
+ 	 	 	 	 len=strlen(s)+1;
+ 	 	 	 	 if(len>max_size)
+ 	 	 	 	 	{free(max_text);
+ 	 	 	 	 	 if((max_text=malloc(max_size=2*len))==NULL)
+ 	 	 	 	 	 	{fprintf(stderr,"nsort: error window too big\n");
+ 	 	 	 	 	 	 return 1;
+ 	 	 	 	 	 	}
+ 	 	 	 	 	}
+ 	 	 	 	 memcpy(max_text,s,len);
+ 	 	 	 	 decnum_parse(&max_num,max_text);
+ 	 	 	 	}
+ 	 	 	}
+ 	 	 else
+ 	 	 	{x.key=float_key(linekey(x.line));
+ 	 	 	 if(window_by_key)
+ 	 	 	 	{x.value=dblkey(key_field(x.line)); // parsed again as a double, as at (say) 1.7e9 floats are 128 apart
+ 	 	 	 	 if(x.value>max_value) max_value=x.value;
+ 	 	 	 	}
+ 	 	 	}
+ 	 	}
+ 	 if(last.line!=NULL && pending_less(&x,&last))
+ 	 	++late; // lines that sort before this have already been output
+ 	 heap_push(heap,nheap++,x);
+ 	 output=false;
+ 	 while(nheap>0 && ((window_lines>0 && nheap>window_lines) || (window_by_key && window_release(&heap[0],max_value,&max_num,&key_num))))
+ 	 	{x=heap_pop(heap,nheap--);
+ 	 	 window_write(&x,&last);
+ 	 	 output=true;
+ 	 	}
+ 	 if(output && flush) fflush(stdout);
+ 	}
+ while(nheap>0) // end of input, so output the lines still waiting
+ 	{x=heap_pop(heap,nheap--);
+ 	 window_write(&x,&last);
+ 	}
+ free(last.line);
+ free(heap);
+ free(max_text);
+ if(verbose)
+ 	{fprintf(stderr,"nsort: sorted %u lines through a window of ",nread);
+ 	 if(window_lines>0) fprintf(stderr,"%u lines%s",window_lines,window_by_key ? " and " : "");
+ 	 if(window_by_key) fprintf(stderr,"key difference %s",window_key_text);
+ 	 fprintf(stderr," in %.3f secs (heap size %u), %u lines arrived too late so were output out of order\n",(clock()-start_t)/(double)(CLOCKS_PER_SEC),(unsigned int)heap_size,late);
+ 	}
+ return 0;
+}
+
+/* long_option: process a long option (--name value) from the command line, argv[0] is the option */
+/* returns false if the option is not valid, otherwise *argc and *argv are updated to skip over any value used */
+static bool long_option(int *argc,char ***argv)
+{const char *opt=(**argv)+2; // skip "--"
+ unsigned long v;
+ if(strcmp(opt,"field")==0)
+ 	{if(!option_value(argc,argv,opt,1,UINT_MAX,&v)) return false; // 1 is the 1st field
+ 	 sort_field=(unsigned int)v;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"header")==0)
+ 	{if(!option_value(argc,argv,opt,0,UINT_MAX,&v)) return false;
+ 	 header_lines=(unsigned int)v;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"by-column")==0)
+ 	{// comma separated list of fields eg 2,4,5
+ 	 char *s,*end;
+ 	 if(*argc<=1)
+ 		{fprintf(stderr,"nsort: --%s needs a list of fields\n",opt);
+ 		 return false;
+ 		}
+ 	 --*argc;
+ 	 ++*argv;
+ 	 s=**argv;
+ 	 by_columns=realloc(by_columns,(strlen(s)/2+1)*sizeof(unsigned int)); // list can have at most this many numbers
+ 	 if(by_columns==NULL) return false;
+ 	 nby_columns=0;
+ 	 do {v=strtoul(s,&end,10);
+ 	 	 if(end==s || v<1 || v>UINT_MAX || (*end!=',' && *end!='\0'))
+ 	 	 	{fprintf(stderr,"nsort: invalid list of fields \"%s\" for --%s (expected eg 2,4 where 1 is the 1st field)\n",**argv,opt);
+ 	 	 	 return false;
+ 	 	 	}
+ 	 	 by_columns[nby_columns++]=(unsigned int)v;
+ 	 	 s=end+1;
+ 	 	} while(*end==',');
+ 	 return true;
+ 	}
+ if(strcmp(opt,"key-expr")==0)
+ 	{const char *errmsg;
+ 	 if(*argc<=1)
+ 		{fprintf(stderr,"nsort: --%s needs an expression\n",opt);
+ 		 return false;
+ 		}
+ 	 --*argc;
+ 	 ++*argv;
+ 	 if((key_expr=keyexpr_compile(**argv,&errmsg))==NULL)
+ 	 	{fprintf(stderr,"nsort: error in --%s \"%s\" : %s\n",opt,**argv,errmsg);
+ 	 	 return false;
+ 	 	}
+ 	 key_expr_text=**argv;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"exact")==0)
+ 	{exact_numbers=true;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"double")==0)
+ 	{double_keys=true;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"dict")==0)
+ 	{engine=ENGINE_DICT;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"engine")==0)
+ 	{if(*argc<=1)
+ 		{fprintf(stderr,"nsort: --%s needs a value\n",opt);
+ 		 return false;
+ 		}
+ 	 --*argc;
+ 	 ++*argv;
+ 	 if((engine=engine_from_name(**argv))==NOS_ENGINES)
+ 	 	{fprintf(stderr,"nsort: invalid value \"%s\" for --%s (must be auto, qsort, radix, merge, dict, count, lcp, burst, dpqsort, vqsort, msd or flag)\n",**argv,opt);
+ 	 	 return false;
+ 	 	}
+ 	 return true;
+ 	}
+ if(strcmp(opt,"split-by-range")==0)
+ 	{if(!option_value(argc,argv,opt,1,UINT_MAX,&v)) return false;
+ 	 split_files=(unsigned int)v;
+ 	 split_size=0; // the last of --split-by-range and --split-size is used
+ 	 return true;
+ 	}
+ if(strcmp(opt,"split-size")==0)
+ 	{if(!size_value(argc,argv,opt,&split_size)) return false;
+ 	 split_files=0;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"workers")==0)
+ 	{if(!option_value(argc,argv,opt,1,MAX_WORKERS,&v)) return false;
+ 	 nos_workers=(unsigned int)v;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"worker")==0)
+ 	{worker_mode=true; // only used on the command line of the worker processes started by --workers N
+ 	 return true;
+ 	}
+ if(strcmp(opt,"window")==0)
+ 	{if(!option_value(argc,argv,opt,1,UINT_MAX,&v)) return false;
+ 	 window_lines=(unsigned int)v;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"window-key")==0)
+ 	{char *end;
+ 	 if(*argc<=1)
+ 	 	{fprintf(stderr,"nsort: --%s needs a value\n",opt);
+ 	 	 return false;
+ 	 	}
+ 	 --*argc;
+ 	 ++*argv;
+ 	 window_key=strtod(**argv,&end);
+ 	 if(end==**argv || *end!='\0' || !(window_key>=0) || strspn(**argv,"0123456789.")!=strlen(**argv)) // no exponent, so --exact sees the same number
+ 	 	{fprintf(stderr,"nsort: invalid value \"%s\" for --%s (must be a number >= 0 , without an exponent)\n",**argv,opt);
+ 	 	 return false;
+ 	 	}
+ 	 window_key_text=**argv;
+ 	 window_by_key=true;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"incremental")==0)
+ 	{incremental=true;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"cache-dir")==0)
+ 	{if(*argc<=1)
+ 		{fprintf(stderr,"nsort: --%s needs a value\n",opt);
+ 		 return false;
+ 		}
+ 	 --*argc;
+ 	 ++*argv;
+ 	 cache_dir=**argv;
+ 	 return true;
+ 	}
+ if(strcmp(opt,"cache-max")==0)
+ 	return size_value(argc,argv,opt,&cache_max);
+ if(strcmp(opt,"memory")==0)
+ 	{memory_set=true;
+ 	 return size_value(argc,argv,opt,&memory_budget);
+ 	}
+ if(strcmp(opt,"cpus")==0)
+ 	{if(*argc<=1)
+ 		{fprintf(stderr,"nsort: --%s needs a value\n",opt);
+ 		 return false;
+ 		}
+ 	 --*argc;
+ 	 ++*argv;
+ 	 if(!set_cpus(**argv)) // set now, so all threads (and --workers N processes) started later inherit it
+ 	 	{fprintf(stderr,"nsort: invalid value \"%s\" for --%s (must be a list of processor numbers and ranges that this process can use, eg 0-3,8)\n",**argv,opt);
+ 	 	 return false;
+ 	 	}
+ 	 return true;
+ 	}
+ if(strcmp(opt,"out-prefix")==0)
+ 	{if(*argc<=1)
+ 		{fprintf(stderr,"nsort: --%s needs a value\n",opt);
+ 		 return false;
+ 		}
+ 	 --*argc;
+ 	 ++*argv;
+ 	 out_prefix=**argv;
+ 	 return true;
+ 	}
+ fprintf(stderr,"nsort: invalid option --%s\n",opt);
+ return false;
+}
+
+
+/* sort input lines */
+int main(int argc, char *argv[])
+{
+ bool numeric = false; /* true if numeric sort */
+ char c;
+ int nread;
+ clock_t start_t,end_t; 
+ if((worker_argv=malloc((argc+4)*sizeof(char *)))!=NULL) // space for --worker and --memory SIZE (added below) then NULL
+ 	{// save the command line for the worker processes of --workers N before it is changed by the argument parser below
+ 	 memcpy(worker_argv,argv,argc*sizeof(char *));
+ 	 worker_argv[argc]="--worker";
+ 	 worker_argv[argc+1]=NULL;
+ 	}
+ /* based on argument parser from K&R pp 117. allows both nsort -nq and nsort -n -q */
+ while(--argc>0 && (*++argv)[0] == '-')
+ 	{if((*argv)[1]=='-')
+ 		{// long option eg --field N
+ 		 if(!long_option(&argc,&argv))
+ 		 	argc= -1; //cause "usage" message then exit
+ 		 continue;
+ 		}
+ 	 while( (c= *++argv[0]) ) /* yes this is an assignment operator !, extra brackets due to gcc warning. */
+ 		switch(tolower(c))
+ 			{
+ 			 case 'c': 	csv_mode=true;  break;
+ 			 case 'n': 	numeric=true;  break;
+ 			 case 'q': 	quoted_numbers=true; numeric=true; break; // -q implies -n
+ 			 case 'u':  do_uniq=true;  break;
+ 			 case 'v':  verbose=true;  break;  
+ 			 case 'j':  // -j N (or -jN) max number of threads
+ 			 	{char *s=argv[0]+1,*end;
+ 			 	 unsigned long v;
+ 			 	 if(*s=='\0')
+ 			 	 	{if(argc<=1)
+ 			 	 		{fprintf(stderr,"nsort: -j needs a value\n");
+ 			 	 		 argc= -1;
+ 			 	 		 break;
+ 			 	 		}
+ 			 	 	 --argc;
+ 			 	 	 s= *++argv;
+ 			 	 	}
+ 			 	 v=strtoul(s,&end,10);
+ 			 	 if(end==s || *end!='\0' || v<1 || v>MAX_THREADS)
+ 			 	 	{fprintf(stderr,"nsort: invalid value \"%s\" for -j (must be between 1 and %d)\n",s,MAX_THREADS);
+ 			 	 	 argc= -1;
+ 			 	 	}
+ 			 	 else
+ 			 	 	set_max_threads((int)v);
+ 			 	 argv[0]=s+strlen(s)-(*s!='\0'); // the rest of this argument is the value, so skip to its last character
+ 			 	}
+ 			 	break;
+ 			 case '?':  // falls through to 'h' below
+ 			 case 'h': 	
+	 					argc= -1; //cause "usage" message then exit
+	 					break;
+ 			 default: 	fprintf(stderr,"nsort: invalid option -%c\n",c);
+ 				 		argc= -1;
+ 				 		break;
+ 			}
+ 	}
+ if(argc>0) // we want 0 as only -xx arguments expected on command line
+ 	{fprintf(stderr,"nsort: Invalid argument \"%s\"\n",*argv);
+	 argc= -1; //cause "usage" message then exit
+	} 				
+ if(argc==0 && (split_files>0 || split_size>0) && (nby_columns>0 || key_expr!=NULL))
+ 	{fprintf(stderr,"nsort: --split-by-range and --split-size cannot be used with --by-column or --key-expr\n");
+ 	 argc= -1;
+ 	}
+ if(worker_mode)
+ 	{// a worker process started by --workers N, it is sent just the lines to sort (the header lines are output by the process that started it)
+ 	 nos_workers=0;
+ 	 header_lines=0;
+ 	}
+ if(argc==0 && nos_workers>0 && (nby_columns>0 || key_expr!=NULL || split_files>0 || split_size>0))
+ 	{fprintf(stderr,"nsort: --workers cannot be used with --by-column, --key-expr, --split-by-range or --split-size\n");
+ 	 argc= -1;
+ 	}
+ if(argc==0 && incremental && (nby_columns>0 || key_expr!=NULL || split_files>0 || split_size>0 || nos_workers>0))
+ 	{fprintf(stderr,"nsort: --incremental cannot be used with --by-column, --key-expr, --split-by-range, --split-size or --workers\n");
+ 	 argc= -1;
+ 	}
+ if(argc==0 && (window_lines>0 || window_by_key) && (csv_mode || nby_columns>0 || key_expr!=NULL || split_files>0 || split_size>0 || nos_workers>0 || incremental))
+ 	{fprintf(stderr,"nsort: --window and --window-key cannot be used with -c, --by-column, --key-expr, --split-by-range, --split-size, --workers or --incremental\n");
+ 	 argc= -1;
+ 	}
+ if(argc==0 && window_by_key && !numeric)
+ 	{fprintf(stderr,"nsort: --window-key can only be used for numeric sorts (-n)\n");
+ 	 argc= -1;
+ 	}
+ if(argc<0)
+ 	{fprintf(stderr,"nsort version %s created at %s on %s\n sorts stdin to stdout printing the result in increasing order\n",VERSION,__TIME__,__DATE__);
+ 	 if(verbose) 
+ 		{
+#if defined(USE_FAST_ATOF)  			
+ #ifdef nsort_num_float /* if defined do numeric sorts with float rather than double */	 		
+	 	 fprintf(stderr,"Compiled with gcc %s pointer size=%d numeric compare type=float fast_strtof uses u%d\n",__VERSION__,__SIZEOF_POINTER__,fast_strtof_u);
+ #else
+	 	 fprintf(stderr,"Compiled with gcc %s pointer size=%d numeric compare type=double fast_strtof uses u%d\n",__VERSION__,__SIZEOF_POINTER__,fast_strtof_u);	 
+ #endif
+#else
+ #ifdef __USE_MINGW_ANSI_STDIO
+	 	 fprintf(stderr,"Compiled with gcc %s pointer size=%d  __USE_MINGW_ANSI_STDIO defined\n",__VERSION__,__SIZEOF_POINTER__);
+ #else
+		 fprintf(stderr,"Compiled with gcc %s pointer size=%d  __USE_MINGW_ANSI_STDIO NOT defined\n",__VERSION__,__SIZEOF_POINTER__);
+ #endif	
+#endif 
+		}	
+ 	 fprintf(stderr,"Usage: nsort [-cnquv?h] [-j N] [--cpus LIST] [--field N] [--header N] [--by-column LIST [--out-prefix PREFIX]] [--key-expr EXPR] [--dict] [--engine NAME] [--double] [--exact] [--split-by-range N | --split-size SIZE [--out-prefix PREFIX]] [--workers N] [--incremental] [--window N] [--window-key D] [--cache-dir DIR [--cache-max SIZE]] [--memory SIZE]\n");
+	 fprintf(stderr,"-c input is a csv file, quoted fields can contain commas and newlines (so a record can span several lines)\n");
+	 fprintf(stderr,"   with -n quoted numbers are allowed\n");
+	 fprintf(stderr,"-n lines are assumed to start with numbers and sorting is done on these.\n");
+	 fprintf(stderr,"   if the numbers are identical the lines are sorted as strings\n");
+	 fprintf(stderr,"-q sort on initial numbers in double quotes (implies -n) \n");
+	 fprintf(stderr,"   otherwise sort lines as strings\n");
+	 fprintf(stderr,"-u only print lines that are unique (ie deletes duplicates)\n");
+	 fprintf(stderr,"-v verbose output (to stderr) - prints execution time etc\n");
+	 fprintf(stderr,"-j N use at most N threads (default all the processors this process can use), small inputs use fewer\n");
+	 fprintf(stderr,"--cpus LIST only run on the processors in LIST (eg 0-3,8), the number of threads is at most the number of these\n");
+	 fprintf(stderr,"-? or -h prints (this) help message then exists\n");
+	 fprintf(stderr,"--field N sort on field N (fields are separated by commas, 1 is the 1st field) rather than the start of the line\n");
+	 fprintf(stderr,"--header N the first N lines are headers, they are output first (unchanged) and are not sorted\n");
+	 fprintf(stderr,"--by-column LIST sort numerically on each of the fields in LIST (eg 2,4) in turn, the fields are only read once\n");
+	 fprintf(stderr,"   if LIST has more than one field the result of sorting on field N is written to the file PREFIXN.csv\n");
+	 fprintf(stderr,"--out-prefix PREFIX set PREFIX for --by-column (default nsort_col) or --split-by-range and --split-size (default nsort_part)\n");
+	 fprintf(stderr,"--key-expr EXPR sort numerically on the value of EXPR which can use fields c1,c2,... numbers, + - * / ( ) abs() min() and max()\n");
+	 fprintf(stderr,"   eg --key-expr c2+c3 . Lines where a field used is not a number sort first, lines with the same value are sorted as strings\n");
+	 fprintf(stderr,"--dict string sort using a dictionary of the different values of the field sorted on, fast when there are only a few different values\n");
+	 fprintf(stderr,"--engine NAME sort algorithm to use: auto (default, chosen from a sample of the input - -v shows the choice), qsort, radix (numeric sorts), merge (nearly sorted input), dict, count, lcp, burst, dpqsort, vqsort, msd or flag\n");
+	 fprintf(stderr,"--double numeric sorts compare numbers as doubles (lines are sorted on floats, then only lines with the same float are compared as doubles)\n");
+	 fprintf(stderr,"--exact numeric sorts compare numbers exactly using their decimal digits (like GNU sort -n, exponents such as 1e5 are not used)\n");
+	 fprintf(stderr,"--split-by-range N write the sorted lines to N files PREFIX1.csv ... PREFIXN.csv (in parallel) rather than stdout, each holds a range of keys with about the same number of lines\n");
+	 fprintf(stderr,"--split-size SIZE as --split-by-range but each file holds about SIZE bytes (eg 100M), lines with the same key are always in the same file\n");
+	 fprintf(stderr,"--incremental output the smallest lines as soon as they are sorted (eg for nsort | less) rather than after the whole sort\n");
+	 fprintf(stderr,"--window N sort a stream that is nearly in order, keeping at most N lines waiting to be output (lines that arrive later than this are output out of order)\n");
+	 fprintf(stderr,"--window-key D as --window for numeric sorts, a line is output once a number more than D bigger than its number has been read (eg timestamps up to D late)\n");
+	 fprintf(stderr,"--cache-dir DIR save sorted outputs in DIR, so sorting the same input with the same options again just copies the saved output\n");
+	 fprintf(stderr,"--cache-max SIZE max total size of the files in the --cache-dir directory (default 1G), the least recently used are deleted\n");
+	 fprintf(stderr,"--memory SIZE memory the lines can use (eg 2G) before they are sorted in runs saved to temporary files then merged, default %d%% of the memory available (allowing for container limits), with --workers N this is shared with the workers. -c, --by-column, --key-expr, --split-* and --incremental give an error if the input is bigger than this\n",MEMORY_BUDGET_PERCENT);
+	 fprintf(stderr,"--workers N sort using N worker processes (copies of nsort), each sorts a range of keys chosen from a sample of the lines\n");
+	 return 1;
+	} 	
+ if(verbose) 
+ 	{
+#if defined(USE_FAST_ATOF) 		 		
+ #ifdef nsort_num_float /* if defined do numeric sorts with float rather than double */	 		
+	 fprintf(stderr,"nsort version %s compiled with gcc %s pointer size=%d numeric compare type=float fast_strtof uses u%d\n",VERSION,__VERSION__,__SIZEOF_POINTER__,fast_strtof_u);
+ #else
+	 fprintf(stderr,"nsort version %s compiled with gcc %s pointer size=%d numeric compare type=double fast_strtof uses u%d\n",VERSION,__VERSION__,__SIZEOF_POINTER__,fast_strtof_u);	 
+ #endif	 
+#else
+ #ifdef __USE_MINGW_ANSI_STDIO
+	 	 fprintf(stderr,"Compiled with gcc %s pointer size=%d  __USE_MINGW_ANSI_STDIO defined\n",__VERSION__,__SIZEOF_POINTER__);
+ #else
+		 fprintf(stderr,"Compiled with gcc %s pointer size=%d  __USE_MINGW_ANSI_STDIO NOT defined\n",__VERSION__,__SIZEOF_POINTER__);
+ #endif	
+#endif 
+	}
+ if(window_lines>0 || window_by_key)
+ 	return sort_window(numeric); // --window N or --window-key D sorts a stream as it is read
+ if(!worker_mode) // a worker is only sent lines that fitted in its parent's budget, and can sort them in runs if need be
+ 	whole_input= csv_mode ? "-c" : nby_columns>0 ? "--by-column" : key_expr!=NULL ? "--key-expr" : split_files>0 ? "--split-by-range" :
+ 		split_size>0 ? "--split-size" : incremental ? "--incremental" : NULL; // these all need the whole input in memory, so fail if it is bigger than the budget
+ if(!memory_set)
+ 	memory_budget=memory_limit()/100*MEMORY_BUDGET_PERCENT; // 0 if the memory available is not known
+ if(nos_workers>0 && memory_budget>0 && worker_argv!=NULL)
+ 	{// --workers N: the workers run in the same container as this process, so the budget is shared. This process holds all the lines while the workers sort them,
+ 	 // so it gets half the budget and the workers share the other half (--memory budget/2N is added to their command line, a worker given more lines than that sorts them in runs).
+ 	 // If the input is bigger than this process's half it is sorted here by sort_external() rather than by the workers.
+ 	 static char worker_memory[32];
+ 	 int i;
+ 	 memory_budget/=2;
+ 	 snprintf(worker_memory,sizeof(worker_memory),"%" PRIu64,memory_budget/nos_workers>0 ? memory_budget/nos_workers : 1);
+ 	 for(i=0;worker_argv[i]!=NULL;++i);
+ 	 worker_argv[i]="--memory"; // added after any --memory on the command line, so this is the one the worker uses
+ 	 worker_argv[i+1]=worker_memory;
+ 	 worker_argv[i+2]=NULL;
+ 	}
+ if(verbose) fprintf(stderr,"nsort: %d threads, memory budget %" PRIu64 " MB\n",nos_threads(),memory_budget>>20);
+ if(worker_mode || nby_columns>0 || split_files>0 || split_size>0)
+ 	cache_dir=NULL; // --cache-dir is only used when the output is written to stdout (and not by the workers for --workers N, which are sent different input each time)
+ cache_hash_init(&input_hash);
+ /* now do the actual sorting ... */
+ start_t=clock();		
+ if ((nread=readlines()) >= 0) {
+ 	if(verbose)
+ 		{
+ 		 end_t=clock();
+ 		 fprintf(stderr,"nsort: read in %d lines in %.3f secs\n",nlines,(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 		 start_t=clock();
+ 		}
+    nheader= header_lines<nlines ? header_lines : nlines; // header lines are not sorted
+    if(more_input)
+    	cache_dir=NULL; // the input is too big to hash before sorting it, so --cache-dir cannot be used
+    if(cache_dir!=NULL && cached_output(numeric))
+    	return 0; // --cache-dir DIR, and this input has been sorted with these options before
+    if(nby_columns>0)
+    	return sort_by_columns(); // --by-column LIST
+    if(key_expr!=NULL)
+    	return sort_by_expr(); // --key-expr EXPR
+    {char **body=lineptr+nheader; // lines to sort
+     unsigned int n=nlines-nheader;
+     int (*cmp)(const void*,const void*)= numeric ? (exact_numbers ? myxCompare : double_keys ? mydCompare : mynCompare) : mysCompare;
+     if(more_input)
+     	{if(verbose && nos_workers>0) fprintf(stderr,"nsort: input is bigger than the memory budget, so it is sorted in runs by this process rather than by %u workers\n",nos_workers);
+     	 return sort_external(numeric,cmp); // input is bigger than the memory budget
+     	}
+     if(nos_workers>0 && worker_argv!=NULL)
+     	{int r=sort_by_workers(body,n,cmp); // --workers N
+     	 if(r>=0) return r;
+     	 if(verbose) fprintf(stderr,"nsort: could not start %u worker processes, sorting in this process\n",nos_workers);
+     	}
+     if(incremental)
+     	return sort_incremental(body,n,numeric,cmp); // --incremental writes the lines as they are sorted
+     sort_lines(body,n,numeric,cmp);
+    }
+ 	if(verbose)
+ 		{
+ 		 end_t=clock();
+ 		 fprintf(stderr,"nsort: sort took %.3f secs\n",(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 		 start_t=clock();
+ 		}    	
+	if(split_files>0 || split_size>0)
+		{if(write_split(lineptr+nheader,nlines-nheader,numeric)!=0) return 1; // --split-by-range N or --split-size SIZE
+		}
+	else
+		writelines(stdout,lineptr+nheader); /* write out lines in sorted order */
+ 	if(verbose)
+ 		{
+ 		 end_t=clock();
+ 		 fprintf(stderr,"nsort: output written in %.3f secs\n",(end_t-start_t)/(double)(CLOCKS_PER_SEC));
+ 		} 	
+	return 0;
+   } else if(nread== -2) {
+	fprintf(stderr,"nsort: error input is bigger than the memory budget of %" PRIu64 " MB, and %s needs all of it in memory (--memory SIZE sets the budget)\n",memory_budget>>20,whole_input);
+	return 1;
+   } else {
+	fprintf(stderr,"nsort: error input too big to sort\n");
+	return 1;
+   }
+}
+
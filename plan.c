@@ -0,0 +1,233 @@
+/* plan.c
+   ======
+   choice of the sort engine to use, based on measurements from a sample of the lines to be sorted.
+
+   No one sort algorithm is best for every input, for example:
+   	- string sorts of input that is already nearly sorted (or reversed) are close to O(n) with a natural merge sort (mergesort.c)
+   	- numeric sorts are fastest converting each number once then using a radix sort (keysort.c), this is even faster than a merge sort for input that is already sorted
+   	- numeric sorts where the keys are integers in a small range (eg status codes or hour of the day) only need a counting sort (keysort.c)
+   	- string sorts where the field sorted on only has a few different values (and is the last field) are fastest using a dictionary of the values (dictsort.c)
+   	- string sorts of whole lines that are much bigger than the cache are fastest with a burstsort, which avoids most cache misses (strsort.c)
+   	- smaller string sorts of whole lines with long common prefixes (eg URLs or file paths) are faster with a merge sort that does not rescan the common prefixes (strsort.c)
+   	- anything else uses qsort() (qsort.c) which is always O(n*log(n)).
+
+   plan_sample() looks at about PLAN_SAMPLE lines (so takes a negligible time compared to the sort) and measures:
+   	- presortedness: the fraction of adjacent lines that are out of order (in blocks of consecutive lines spread through the input) and the fraction of random pairs of lines that are out of order (inversions)
+   	- the number of different keys in the sample and so the fraction of duplicate keys
+   	- for string sorts the mean common prefix of adjacent keys once the sample is sorted (the sample is only a small part of the input so this underestimates the common prefixes in the sorted input)
+   	- for numeric sorts the type (integer or float) and range of the keys
+   	- the mean and max line length.
+   plan_engine() then uses these to choose the engine, and plan_print() shows the result (nsort -v).
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h> /* for bool */
+#include <string.h>
+#include <float.h>
+#include "plan.h"
+#include "csv.h"
+#include "qsort.h"
+#include "keysort.h" /* for COUNT_MAX_KEYS */
+
+#define PLAN_SAMPLE 4096 /* number of lines (and pairs of lines) sampled */
+#define PLAN_BLOCKS 16 /* adjacent lines are sampled in this many blocks spread evenly through the input */
+#define PLAN_MIN_LINES 1000 /* below this qsort() is always used, as any other engine has little to gain */
+#define PLAN_PRESORTED 0.01 /* if less than this fraction of adjacent lines are out of order (ie the mean run length is over 100) use a merge sort. The same applies for reversed input */
+#define PLAN_DICT_DUPS 16 /* use a dictionary for string sorts when on average each key in the sample appears at least this many times ... */
+#define PLAN_LCP_MIN 10 /* use the LCP merge sort for whole line string sorts if the mean common prefix of adjacent sampled lines is at least this */
+#define PLAN_BURST_BYTES (8*1024*1024) /* use burstsort for whole line string sorts if the lines take more than this many bytes (ie they are bigger than the cache) */
+#define PLAN_DICT_TAILS 0.1 /* ... and less than this fraction of lines have anything after the key (otherwise lines with the same key have to be sorted as strings, and qsort() is faster) */
+
+static const char *engine_names[NOS_ENGINES]={"auto","qsort","radix","merge","dict","count","lcp","burst","dpqsort","vqsort","msd","flag"};
+
+const char *engine_name(enum sort_engine e)
+{return e<NOS_ENGINES ? engine_names[e] : "?";
+}
+
+enum sort_engine engine_from_name(const char *name)
+{int e;
+ for(e=0;e<NOS_ENGINES;++e)
+ 	if(strcmp(name,engine_names[e])==0) break;
+ return (enum sort_engine)e;
+}
+
+static uint32_t rnd(uint32_t *state) /* xorshift32 pseudo random number generator, a fixed seed is used so the plan for an input is always the same */
+{uint32_t x= *state;
+ x^=x<<13;
+ x^=x>>17;
+ x^=x<<5;
+ return *state=x;
+}
+
+struct strkey /* a string key in the sample */
+	{const char *key;
+	 size_t len; // not including the ',' or '\0' that ends the field
+	};
+
+static int strkeyCompare(const void *a,const void *b)
+{const struct strkey *ka=a,*kb=b;
+ int r=memcmp(ka->key,kb->key,ka->len<kb->len ? ka->len : kb->len);
+ if(r!=0) return r;
+ return ka->len<kb->len ? -1 : (ka->len>kb->len);
+}
+
+static int floatCompare(const void *a,const void *b)
+{float fa= *(const float *)a,fb= *(const float *)b;
+ return fa<fb ? -1 : (fa>fb);
+}
+
+/* plan_sample: measure a sample of lines[0..n-1] (the lines to be sorted), results go into *s */
+/* returns false if there is not enough memory (*s is then set as if the input was random) */
+bool plan_sample(struct sort_stats *s,char **lines,unsigned int n,const struct plan_params *p)
+{unsigned int i,j,b,pairs,from,blocklen,nblocks,out_of_order;
+ uint32_t seed=0x9e3779b9;
+ uint64_t total_len=0;
+ float *nkeys=NULL;
+ struct strkey *skeys=NULL;
+ memset(s,0,sizeof(*s));
+ s->n=n;
+ s->sample= n<PLAN_SAMPLE ? n : PLAN_SAMPLE;
+ s->descents=s->inversions=0.5;
+ s->type= p->numkey==NULL ? KEY_STRING : KEY_INTEGER;
+ s->whole_line= p->field<=1;
+ if(n<2) return true;
+ /* adjacent lines, in blocks spread through the input */
+ blocklen=s->sample/PLAN_BLOCKS;
+ nblocks=PLAN_BLOCKS;
+ if(blocklen<2)
+ 	{blocklen=s->sample; // small input, just one block
+ 	 nblocks=1;
+ 	}
+ pairs=out_of_order=0;
+ for(b=0;b<nblocks;++b)
+ 	{from= nblocks>1 ? (unsigned int)(((uint64_t)(n-blocklen)*b)/(nblocks-1)) : 0;
+ 	 for(i=from+1;i<from+blocklen;++i,++pairs)
+ 	 	if(p->cmp(&lines[i-1],&lines[i])>0) ++out_of_order;
+ 	}
+ s->descents=out_of_order/(double)pairs;
+ /* random lines - pairs are used for inversions, and the lines themselves for the key and line length measurements */
+ if(p->numkey!=NULL) nkeys=malloc(s->sample*sizeof(float));
+ else skeys=malloc(s->sample*sizeof(struct strkey));
+ if(nkeys==NULL && skeys==NULL)
+ 	{s->distinct=s->sample; // assume keys are all different
+ 	 return false;
+ 	}
+ out_of_order=0;
+ s->min_key=FLT_MAX;
+ s->max_key= -FLT_MAX;
+ for(j=0;j<s->sample;++j)
+ 	{unsigned int l1=rnd(&seed)%n,l2=rnd(&seed)%n;
+ 	 const char *line=lines[l1]; // uniformly random line
+ 	 size_t len;
+ 	 if(l1>l2) {unsigned int t=l1; l1=l2; l2=t;}
+ 	 if(l1<l2 && p->cmp(&lines[l1],&lines[l2])>0) ++out_of_order;
+ 	 len=strlen(line);
+ 	 total_len+=len;
+ 	 if(len>s->max_len) s->max_len=len;
+ 	 if(nkeys!=NULL)
+ 	 	{float v=p->numkey(line);
+ 	 	 nkeys[j]=v;
+ 	 	 if(v== -FLT_MAX)
+ 	 	 	{s->not_numbers++; // not a number, so ignored for the key type and range
+ 	 	 	 continue;
+ 	 	 	}
+ 	 	 if(v<s->min_key) s->min_key=v;
+ 	 	 if(v>s->max_key) s->max_key=v;
+ 	 	 if(v>-16777216.0f && v<16777216.0f && v!=(float)(int32_t)v) s->type=KEY_FLOAT; // has a fractional part (floats outside +/-2^24 are always integers)
+ 	 	}
+ 	 else
+ 	 	{const char *key=csv_field(line,p->field,p->quoted);
+ 	 	 if(key==NULL) key="";
+ 	 	 skeys[j].key=key;
+ 	 	 skeys[j].len=csv_field_end(key,p->quoted)-key;
+ 	 	 if(key[skeys[j].len]!='\0') s->tails+=1.0/s->sample;
+ 	 	}
+ 	}
+ s->inversions=out_of_order/(double)s->sample;
+ s->mean_len=total_len/(double)s->sample;
+ if(s->min_key>s->max_key) s->min_key=s->max_key=0; // no numbers found
+ /* count different keys by sorting the sampled keys */
+ s->distinct=1;
+ if(nkeys!=NULL)
+ 	{qsort(nkeys,s->sample,sizeof(float),floatCompare);
+ 	 for(j=1;j<s->sample;++j)
+ 	 	if(nkeys[j]!=nkeys[j-1]) s->distinct++;
+ 	}
+ else
+ 	{qsort(skeys,s->sample,sizeof(struct strkey),strkeyCompare);
+ 	 for(j=1;j<s->sample;++j)
+ 	 	{const char *a=skeys[j-1].key,*b=skeys[j].key;
+ 	 	 size_t h=0;
+ 	 	 if(strkeyCompare(&skeys[j],&skeys[j-1])!=0) s->distinct++;
+ 	 	 while(a[h]==b[h] && a[h]!='\0') ++h;
+ 	 	 s->mean_lcp+=h;
+ 	 	}
+ 	 s->mean_lcp/=s->sample;
+ 	}
+ s->dup_ratio=1.0-s->distinct/(double)s->sample;
+ free(nkeys);
+ free(skeys);
+ return true;
+}
+
+/* plan_engine: choose the engine to use based on the measurements in *s */
+enum sort_engine plan_engine(const struct sort_stats *s,bool numeric)
+{if(s->n<PLAN_MIN_LINES)
+ 	return ENGINE_QSORT;
+ if(numeric)
+ 	{if(s->type==KEY_INTEGER && s->not_numbers<s->sample && s->max_key-s->min_key+2<=COUNT_MAX_KEYS)
+ 		return ENGINE_COUNT; // small range of integers (if the sample missed a key outside this range the radix sort will be used instead)
+ 	 return ENGINE_RADIX;
+ 	}
+ if(s->descents<PLAN_PRESORTED || s->descents>1.0-PLAN_PRESORTED)
+ 	return ENGINE_MERGE; // long runs of sorted (or reversed) lines
+ if((uint64_t)s->distinct*PLAN_DICT_DUPS<=s->sample && s->tails<PLAN_DICT_TAILS)
+ 	return ENGINE_DICT; // few different keys
+ if(s->whole_line && s->n*(s->mean_len+1)>PLAN_BURST_BYTES)
+ 	return ENGINE_BURST; // lots of lines
+ if(s->whole_line && s->mean_lcp>=PLAN_LCP_MIN)
+ 	return ENGINE_LCP; // long common prefixes
+ return ENGINE_QSORT;
+}
+
+static const char *type_names[]={"string","integer","float"};
+
+/* plan_print: print the measurements in *s and the engine e chosen to fp */
+void plan_print(FILE *fp,const struct sort_stats *s,enum sort_engine e)
+{fprintf(fp,"nsort: plan from a sample of %u of %u lines:\n",s->sample,s->n);
+ fprintf(fp,"  presorted: %.1f%% of adjacent lines out of order (about %.0f runs), %.1f%% of random pairs out of order\n",
+ 	100.0*s->descents,s->descents<0.5 ? s->descents*s->n+1 : (1.0-s->descents)*s->n+1,100.0*s->inversions);
+ fprintf(fp,"  keys: %s, %u different keys in sample (%.1f%% duplicates)",type_names[s->type],s->distinct,100.0*s->dup_ratio);
+ if(s->type==KEY_STRING)
+ 	fprintf(fp,", %.1f%% of lines continue after the key, mean common prefix %.1f",100.0*s->tails,s->mean_lcp);
+ else
+ 	fprintf(fp,", range %g to %g, %u not numbers",s->min_key,s->max_key,s->not_numbers);
+ fprintf(fp,"\n  line length: mean %.1f max %lu\n",s->mean_len,(unsigned long)s->max_len);
+ fprintf(fp,"  engine: %s\n",engine_name(e));
+}
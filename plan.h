@@ -0,0 +1,60 @@
+/* plan.h */
+/* choice of sort engine from a sample of the input - see plan.c */
+#ifndef __PLAN_H
+ #define __PLAN_H
+ #include <stdio.h> /* for FILE */
+ #include <stdbool.h> /* for bool */
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	enum sort_engine
+		{ENGINE_AUTO, // let plan_engine() choose
+		 ENGINE_QSORT, // qsort() with the compare routine for the sort
+		 ENGINE_RADIX, // numeric sorts only: radix sort on float keys, then ties sorted with the compare routine (see keysort.c)
+		 ENGINE_MERGE, // natural merge sort, fast for input that is nearly sorted or reversed (see mergesort.c)
+		 ENGINE_DICT, // string sorts only: sort on the ranks of keys in a dictionary of the different keys (see dictsort.c)
+		 ENGINE_COUNT, // numeric sorts only: counting sort when the keys are integers in a small range (see keysort.c)
+		 ENGINE_LCP, // string sorts of whole lines only: merge sort that skips common prefixes (see strsort.c)
+		 ENGINE_BURST, // string sorts of whole lines only: burstsort, for inputs much bigger than the cache (see strsort.c)
+		 ENGINE_DPQ, // numeric sorts only: dual-pivot quicksort on float keys, needs no extra memory for the sort (see keysort.c)
+		 ENGINE_VQS, // numeric sorts only: single pivot quicksort on float keys with a partition using AVX2 instructions (see keysort.c)
+		 ENGINE_MSD, // string sorts of whole lines only: MSD radix sort using parallel threads (see strsort.c)
+		 ENGINE_FLAG, // numeric sorts only: American flag sort (in place MSD radix sort) on float keys, needs no extra memory for the sort (see keysort.c)
+		 NOS_ENGINES
+		};
+
+	enum key_type {KEY_STRING,KEY_INTEGER,KEY_FLOAT};
+
+	struct sort_stats /* measurements from a sample of the lines to be sorted, set by plan_sample() */
+		{unsigned int n; // number of lines to be sorted
+		 unsigned int sample; // number of lines sampled
+		 double descents; // fraction of adjacent lines that are out of order, 0 for sorted input and 1 for reversed input
+		 double inversions; // fraction of random pairs of lines that are out of order, 0.5 for random input
+		 unsigned int distinct; // number of different keys in the sample
+		 double dup_ratio; // fraction of the sample with a key seen before in the sample
+		 double tails; // string sorts: fraction of the sample with more of the line after the key (so lines with the same key still need to be compared)
+		 double mean_lcp; // string sorts: mean length of the common prefix of adjacent lines (from the start of the key) once the sample is sorted
+		 bool whole_line; // string sorts: true if sorting on the whole line (--field 1)
+		 enum key_type type; // numeric sorts: KEY_INTEGER if all keys that are numbers are integers, otherwise KEY_FLOAT
+		 double min_key,max_key; // numeric sorts: range of keys that are numbers
+		 unsigned int not_numbers; // numeric sorts: number of sampled keys that are not numbers
+		 double mean_len; // mean line length
+		 size_t max_len; // max line length
+		};
+
+	struct plan_params /* how the lines will be sorted */
+		{int (*cmp)(const void *,const void *); // compare routine for qsort() of pointers to lines
+		 float (*numkey)(const char *line); // numeric sorts: returns the number being sorted on for a line (-FLT_MAX if not a number), NULL for string sorts
+		 unsigned int field; // string sorts: field sorted on (1 is the start of the line)
+		 bool quoted; // fields can be in double quotes (csv files)
+		};
+
+	bool plan_sample(struct sort_stats *s,char **lines,unsigned int n,const struct plan_params *p); // measure a sample of lines[0..n-1], returns false if no memory
+	enum sort_engine plan_engine(const struct sort_stats *s,bool numeric); // choose the engine to sort with
+	void plan_print(FILE *fp,const struct sort_stats *s,enum sort_engine e); // print the measurements and the engine chosen (for -v)
+	const char *engine_name(enum sort_engine e);
+	enum sort_engine engine_from_name(const char *name); // returns NOS_ENGINES if name is not valid
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
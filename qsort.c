@@ -13,6 +13,10 @@
     - in swapfunc() added special case code for items of 4 and 8 bytes (eg pointers) as these are the most likley things to be sorted with this code (given ya_sort() is faster for sorting numbers).
     - added Introsort functionality to guarantee O(n*log(n)) execution speed.   See "Introspective sorting and selection algorithms" by D.R.Musser,Software practice and experience, 8:983-993, 1997.
     - added option to multitask sort - uses all available processors. For Windows only at present. Only done when PAR_SORT is #defined.
+  Modifications by Peter Miller, 2022
+    - threads are now started with threads.c so the parallel sort is no longer Windows only (on Linux add qsort.c and heapsort.c to the gcc command line to use it in place of the C library qsort()),
+      and the number of threads comes from nos_threads() (so it allows for processor affinity, container cpu limits and nsort -j N / --cpus LIST) rather than counting all the
+      processors in the machine. Small arrays (<2*PAR_MIN_N) use just 1 thread.
     
 */  
 // #define DEBUG /* if defined then print out when we swap to heapsort to stdout . Helps to tune INTROSORT_MULT */
@@ -21,7 +25,7 @@
 #endif
 
 /* the parameters below allow the sort to be "tuned" - the default values should give good results using most modern PC's */ 
-#define PAR_SORT /* if defined use tasks to split sort across multiple processors - only works for Windows at present */
+#define PAR_SORT /* if defined use tasks to split sort across multiple processors (using threads.c) */
 #define USE_INSERTION_SORT 25 /* for n<USE_INSERTION_SORT we use an insertion sort rather than quicksort , as this is faster */
 #define MAX_INS_MOVES 2 /* max allowed number of allowed out of place items while sticking to insertion sort - for the test program, sorting doubles, 2 is the optimum value */	 
 #define USE_MED_3_3 40 /* if > USE_MED_3_3 elements use median of 3 medians of 3, otherwise use median of 3 equally spaced elements */	
@@ -63,9 +67,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h> /* for ssize_t (with -std=c99 on Linux) */
 #ifdef PAR_SORT
- #include <process.h> /* for _beginthreadex */
- #include <windows.h> /* for number of processors */
+ #include "threads.h" /* for thread_start() and nos_threads() */
 #endif
 
 typedef int		 cmp_t(const void *, const void *);
@@ -146,99 +150,9 @@ struct _params
 	 int nos_p_p;
 	};
 	
-static unsigned __stdcall yasortThreadFunc( void * _Arg ) /* parallel thread that can sort a partition */
+static void yasortThreadFunc( void * _Arg ) /* parallel thread that can sort a partition */
 {struct _params* Arg=_Arg;
  local_qsort(Arg->a_p,Arg->n_p,Arg->es_p,Arg->cmp_p,Arg->nos_p_p); /* sort required section  */
- _endthreadex( 0 );
- return 0;
-}
-
-/* we ideally need to know the number of processors - the code below gets this for windows */
-/* this is from https://docs.microsoft.com/de-de/windows/win32/api/sysinfoapi/nf-sysinfoapi-getlogicalprocessorinformation with minor changes by Peter Miller */
-/* see https://programmerall.com/article/52652219244/ for Linux versions */
-
-typedef BOOL (WINAPI *LPFN_GLPI)(
-    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION, 
-    PDWORD);
-
-
-/* Helper function to count set bits in the processor mask. */
-static DWORD CountSetBits(ULONG_PTR bitMask)
-{
-    DWORD LSHIFT = sizeof(ULONG_PTR)*8 - 1;
-    DWORD bitSetCount = 0;
-    ULONG_PTR bitTest = (ULONG_PTR)1 << LSHIFT;    
-    DWORD i;
-    
-    for (i = 0; i <= LSHIFT; ++i)
-    {
-        bitSetCount += ((bitMask & bitTest)?1:0);
-        bitTest/=2;
-    }
-
-    return bitSetCount;
-}
-
-
-static int nos_procs(void) /* return the number of logical processors present. 
-					   This was created by Peter Miller 15/1/2022 based on above code  */
-{
-    BOOL done = FALSE;
-    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION buffer = NULL;
-    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION ptr = NULL;
-    DWORD returnLength = 0;
-    DWORD logicalProcessorCount = 0;
-    DWORD processorCoreCount = 0;
-    DWORD byteOffset = 0; 
-
-    while (!done) /* we need to call GetLogicalProcessorInformation() twice, the 1st time it tells us how big a buffer we need to supply */
-    {
-        DWORD rc = GetLogicalProcessorInformation(buffer, &returnLength);
-
-        if (FALSE == rc) 
-        {
-            if (GetLastError() == ERROR_INSUFFICIENT_BUFFER) 
-            {
-                if (buffer) 
-                    free(buffer);
-
-                buffer = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION)malloc(
-                        returnLength);
-
-                if (NULL == buffer) 
-                {
-                    /* Error: memoery Allocation failure */
-                    return 0;
-                }
-            } 
-            else 
-            {  /* other (unexpected) error */
-                return 0;
-            }
-        } 
-        else
-        {
-            done = TRUE;
-        }
-    }
-
-    ptr = buffer;
-
-    while (byteOffset + sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION) <= returnLength) 
-    {
-        if (ptr->Relationship == RelationProcessorCore) 
-        {
-            processorCoreCount++;
-            /* A hyperthreaded core supplies more than one logical processor.*/
-            logicalProcessorCount += CountSetBits(ptr->ProcessorMask);
-        }
-        byteOffset += sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
-        ptr++;
-    }
-
-    free(buffer);
-
-    return (int)logicalProcessorCount; /* actual number of processor cores is processorCoreCount */
 }
 
 #endif
@@ -306,7 +220,8 @@ static void local_qsort(void *a, size_t n, size_t es, cmp_t *cmp, int nos_p)
  const int max_itn=INTROSORT_MULT*ilog2(n); // max_itn defines point we swap to mid-range pivot, then at 2*max_int we swap to ya_heapsort. if INTROSORT_MULT=0 then "always" use ya_heapsort, 3 means "almost never" use ya_heapsort
 #ifdef PAR_SORT
  struct _params params;
- HANDLE th=NULL; // handle for worker thread
+ thread_t th; // worker thread
+ bool th_active=false; // true while th is running (or has not been joined)
 #else
  P_UNUSED(nos_p); // this param is not used unless PAR_SORT is defined
 #endif	 
@@ -418,12 +333,11 @@ static void local_qsort(void *a, size_t n, size_t es, cmp_t *cmp, int nos_p)
 		 4 cores																21.767 secs = 2.4* speedup
 		 8 cores 						 										19.350 secs = 2.7* speedup (there were only 4 physical cores which may partly explain the reduced improvement)
 	  */ 	
-	  if(th!=NULL && n>2*PAR_MIN_N )
+	  if(th_active && n>2*PAR_MIN_N )
 	  	{// if thread active and partition big enough that we might be able to use a parallel task (2* as we will at least halve the size of the partition for the parallel task) 
-	  	 if( WaitForSingleObject( th, 0 )!=WAIT_TIMEOUT)
-	  		{// if thread has finished
-    		 CloseHandle( th );// Destroy the thread object.
-			 th=NULL; // set to NULL so we can reuse it
+	  	 if( thread_try_join( th ))
+	  		{// if thread has finished (and has been joined) we can reuse it
+			 th_active=false;
 			 // printf("Thread finished at depth %d\n",depth);
 			}
 		}
@@ -434,7 +348,7 @@ static void local_qsort(void *a, size_t n, size_t es, cmp_t *cmp, int nos_p)
 		 if (d1 > es) 
 		 	{
 #ifdef PAR_SORT
-			 if( th==NULL && nos_p>1 && (size_t)(d1 / es) > n/PAR_DIV_N && (size_t)(d1 / es) > PAR_MIN_N)
+			 if( !th_active && nos_p>1 && (size_t)(d1 / es) > n/PAR_DIV_N && (size_t)(d1 / es) > PAR_MIN_N)
 				{// use a worker thread last 2 tests check the overhead of thread creation is worth it.
 				/*	void *a_p;
 	 				size_t n_p;
@@ -447,8 +361,8 @@ static void local_qsort(void *a, size_t n, size_t es, cmp_t *cmp, int nos_p)
 				 params.es_p=es;
 				 params.cmp_p=cmp;
 				 params.nos_p_p=(nos_p)/2; // if we still have spare processors allow more threads to be started
-				 th=(HANDLE)_beginthreadex(NULL,0,yasortThreadFunc,&params,0,NULL);
-				 if(th==NULL) local_qsort(a, d1 / es, es, cmp,0); // if starting thread fails then do in this process.  nos_p=0 so don't run any tasks from here
+				 th_active=thread_start(&th,yasortThreadFunc,&params);
+				 if(!th_active) local_qsort(a, d1 / es, es, cmp,0); // if starting thread fails then do in this process.  nos_p=0 so don't run any tasks from here
 				}
 			 else
 				{local_qsort(a, d1 / es, es, cmp,(nos_p)/2); // recurse for smalest partition so stack depth is bounded at O(log2(n)). Allow more threads from subroutine if we still have some processors spare
@@ -472,7 +386,7 @@ static void local_qsort(void *a, size_t n, size_t es, cmp_t *cmp, int nos_p)
 		 if (d2 > es) 
 		 	{
 #ifdef PAR_SORT
-			 if( th==NULL && nos_p>1 && (size_t)(d2 / es) > n/PAR_DIV_N && (size_t)(d2 / es) > PAR_MIN_N)
+			 if( !th_active && nos_p>1 && (size_t)(d2 / es) > n/PAR_DIV_N && (size_t)(d2 / es) > PAR_MIN_N)
 				{// use a worker thread last 2 tests check the overhead of thread creation is worth it.
 				/*	void *a_p;
 	 				size_t n_p;
@@ -485,8 +399,8 @@ static void local_qsort(void *a, size_t n, size_t es, cmp_t *cmp, int nos_p)
 				 params.es_p=es;
 				 params.cmp_p=cmp;
 				 params.nos_p_p=(nos_p)/2; // if we still have spare processors allow more threads to be started
-				 th=(HANDLE)_beginthreadex(NULL,0,yasortThreadFunc,&params,0,NULL);
-				 if(th==NULL) local_qsort(pn - d2, d2 / es, es, cmp,0); // if starting thread fails then do in this process.  nos_p=0 so don't run any tasks from here
+				 th_active=thread_start(&th,yasortThreadFunc,&params);
+				 if(!th_active) local_qsort(pn - d2, d2 / es, es, cmp,0); // if starting thread fails then do in this process.  nos_p=0 so don't run any tasks from here
 				}
 			 else
 				{local_qsort(pn - d2, d2 / es, es, cmp,(nos_p)/2); // recurse for smalest partition so stack depth is bounded at O(log2(n)). Allow more threads from subroutine if we still have some processors spare
@@ -506,11 +420,9 @@ static void local_qsort(void *a, size_t n, size_t es, cmp_t *cmp, int nos_p)
    	} /* end of main while(1) loop */
  sortend: ; // need a common end point as may be using threads in which case we need to wait for them to complete	
  #ifdef PAR_SORT
- if(th!=NULL)
+ if(th_active)
  	{// if a thread used need to wait for it to finish
- 	 WaitForSingleObject( th, INFINITE );
-    // Destroy the thread object.
-     CloseHandle( th );
+ 	 thread_join( th );
 	}
  #endif
  return;   	
@@ -520,7 +432,7 @@ void qsort(void *a, size_t n, size_t es, cmp_t *cmp)
 {   
  if(n<=1 || es==0) return; /* array of size 1 is sorted by definition, and elements of size 0 cannot be sorted */
 #ifdef PAR_SORT	
- int nos_p=nos_procs() ;/* total number of (logical) processors available */
+ int nos_p=threads_for(n,2*PAR_MIN_N) ;/* number of (logical) processors this sort can use, 1 for small arrays as no partition would be big enough for a thread */
  local_qsort(a, n, es, cmp,nos_p);/* call main worker function */
 #else
  local_qsort(a, n, es, cmp,1);
@@ -0,0 +1,540 @@
+/* strsort.c
+   =========
+   sorting of strings (whole lines), in the same order as strcmp() but without rescanning the start of strings that are already known to be equal.
+
+   lcp_mergesort() is a merge sort that keeps the length of the longest common prefix (LCP) of each string and the string before it.
+   When two strings are merged the LCP's say which is smaller without looking at the strings unless both share the same length of prefix with the last string output,
+   and even then the comparison can start after that prefix. This means each character is compared close to once, however long the shared prefixes are
+   (eg URLs, file paths or log lines that all start with the same hostname), while strcmp() in qsort() rescans the shared prefix for every comparison.
+   The top levels of the merge sort are run in parallel threads.
+   See "Engineering Parallel String Sorting" by T. Bingmann, A. Eberle and P. Sanders (2015) for more details.
+
+   burstsort() is for very large numbers of strings, where qsort() spends most of its time waiting for cache misses as each comparison follows 2 pointers to random places in memory.
+   Strings are inserted one at a time into a trie, reading each string only once (from the start, so sequentially). Each trie node has a bucket for every possible next character,
+   and when a bucket gets more than BURST_LIMIT strings it "bursts" into a new trie node one character further into the strings. The buckets are small enough to be sorted within the cache
+   (using mkqsort(), starting at the character after the ones used by the trie), and the trie is then walked in order to give the sorted strings.
+   See "Cache-conscious sorting of large sets of strings with dynamic tries" by R. Sinha and J. Zobel (2004).
+   Buckets are not burst more than BURST_MAX_DEPTH characters into the strings, as otherwise strings with very long common prefixes create a long chain of trie nodes (which every string has to follow).
+   Buckets that are still big are sorted with lcp_mergesort() which handles long common prefixes well.
+
+   msd_radixsort() is a most significant digit first radix sort, each pass moves the strings into 256 buckets on one character then the buckets are sorted on the next character.
+   The first pass is split between parallel threads, each counting the characters in its block of strings (so the counts need no locking) then moving its strings into the buckets
+   at positions worked out from all the counts. The buckets are then shared out between the threads, biggest first, and each thread sorts its buckets recursively.
+   This means all the threads are busy from the start, where the parallel quicksort in qsort.c has to do its first partition in one thread. Small buckets are sorted with mkqsort().
+   See "Engineering Radix Sort" by P. McIlroy, K. Bostic and M. McIlroy (1993) and "Engineering Parallel String Sorting" (above).
+
+   mkqsort() is the multikey quicksort from "Fast Algorithms for Sorting and Searching Strings" by J. Bentley and R. Sedgewick (1997), it partitions on one character at a time
+   so again each character is only looked at a few times.
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h> /* for bool */
+#include <string.h>
+#include "strsort.h"
+#include "threads.h"
+
+#define LCP_INSERT 16 /* runs this short are sorted with an insertion sort in lcp_mergesort() */
+#define MKQ_INSERT 12 /* mkqsort() uses an insertion sort for this many strings or less */
+#define BURST_LIMIT 8192 /* a bucket in burstsort() with more than this many strings is burst into a new trie node */
+#define BURST_MAX_DEPTH 64 /* max depth of the trie in burstsort() */
+#define LCP_PAR_MIN 100000 /* min number of strings worth giving to a thread in lcp_mergesort() */
+#define MSD_MKQ 256 /* msd_radixsort() uses mkqsort() for buckets of this many strings or less */
+#define MSD_MAX_DEPTH 64 /* buckets in msd_radixsort() still bigger than MSD_MKQ this many characters into the strings are sorted with lcp_mergesort() */
+#define MSD_PAR_MIN 100000 /* min number of strings worth giving to a thread in msd_radixsort() */
+
+typedef unsigned int lcp_t; /* length of a common prefix */
+
+/* lcp_compare: compare strings a and b which are known to be equal for their first *h characters, *h is set to the length of their common prefix */
+/* returns <0, 0 or >0 as strcmp() */
+static inline int lcp_compare(const char *a,const char *b,lcp_t *h)
+{const unsigned char *ua=(const unsigned char *)a,*ub=(const unsigned char *)b;
+ lcp_t k= *h;
+ while(ua[k]==ub[k] && ua[k]!='\0') ++k;
+ *h=k;
+ return (int)ua[k]-(int)ub[k];
+}
+
+/* insertion sort of s[0..n-1] , then set lcp[i] to the common prefix of s[i-1] and s[i] */
+static void lcp_insertion(char **s,lcp_t *lcp,size_t n)
+{size_t i,j;
+ char *t;
+ for(i=1;i<n;++i)
+ 	{t=s[i];
+ 	 for(j=i;j>0 && strcmp(s[j-1],t)>0;--j)
+ 	 	s[j]=s[j-1];
+ 	 s[j]=t;
+ 	}
+ lcp[0]=0;
+ for(i=1;i<n;++i)
+ 	{lcp_t h=0;
+ 	 lcp_compare(s[i-1],s[i],&h);
+ 	 lcp[i]=h;
+ 	}
+}
+
+/* lcp_merge: merge sorted a[0..na-1] (with lcp's la[]) and b[0..nb-1] (lb[]) into out[] (lo[]). Strings from a go first when equal so the merge is stable */
+/* ha and hb are the common prefixes of the next string from a and b with the last string output, the string with the longer common prefix is smaller */
+static void lcp_merge(char **a,lcp_t *la,size_t na,char **b,lcp_t *lb,size_t nb,char **out,lcp_t *lo)
+{size_t i=0,j=0,k=0;
+ lcp_t ha=0,hb=0,h;
+ while(i<na && j<nb)
+ 	{if(ha>hb)
+ 		{out[k]=a[i];
+ 		 lo[k++]=ha;
+ 		 if(++i<na) ha=la[i];
+ 		}
+ 	 else if(hb>ha)
+ 	 	{out[k]=b[j];
+ 	 	 lo[k++]=hb;
+ 	 	 if(++j<nb) hb=lb[j];
+ 	 	}
+ 	 else
+ 	 	{h=ha; // both strings match the last string output for ha characters, so only need to compare after that
+ 	 	 if(lcp_compare(a[i],b[j],&h)<=0)
+ 	 	 	{out[k]=a[i];
+ 	 	 	 lo[k++]=ha;
+ 	 	 	 hb=h;
+ 	 	 	 if(++i<na) ha=la[i];
+ 	 	 	}
+ 	 	 else
+ 	 	 	{out[k]=b[j];
+ 	 	 	 lo[k++]=hb;
+ 	 	 	 ha=h;
+ 	 	 	 if(++j<nb) hb=lb[j];
+ 	 	 	}
+ 	 	}
+ 	}
+ if(i<na)
+ 	{out[k]=a[i];
+ 	 lo[k++]=ha;
+ 	 memcpy(out+k,a+i+1,(na-i-1)*sizeof(char *));
+ 	 memcpy(lo+k,la+i+1,(na-i-1)*sizeof(lcp_t));
+ 	}
+ else if(j<nb)
+ 	{out[k]=b[j];
+ 	 lo[k++]=hb;
+ 	 memcpy(out+k,b+j+1,(nb-j-1)*sizeof(char *));
+ 	 memcpy(lo+k,lb+j+1,(nb-j-1)*sizeof(lcp_t));
+ 	}
+}
+
+struct _lcpsort /* parameters for lcp_sort(), so it can be run as a thread */
+	{char **s,**ts; // strings to sort, and space for a copy of them
+	 lcp_t *lcp,*tl; // lcp's for s[] and ts[]
+	 size_t n; // number of strings
+	 bool to_tmp; // if true result goes into ts[] and tl[], otherwise into s[] and lcp[]
+	 int depth; // number of levels of recursion still to run in parallel threads
+	};
+
+static void lcp_sort(void *arg) /* recursive merge sort, each level alternates between s[] and ts[] so no copying is needed */
+{struct _lcpsort *p=arg;
+ struct _lcpsort left,right;
+ thread_t th;
+ bool started=false;
+ size_t m=p->n/2;
+ if(p->n<=LCP_INSERT)
+ 	{lcp_insertion(p->s,p->lcp,p->n);
+ 	 if(p->to_tmp)
+ 	 	{memcpy(p->ts,p->s,p->n*sizeof(char *));
+ 	 	 memcpy(p->tl,p->lcp,p->n*sizeof(lcp_t));
+ 	 	}
+ 	 return;
+ 	}
+ left= *p;
+ left.n=m;
+ left.to_tmp= !p->to_tmp; // halves are sorted into the other array, then merged back
+ right=left;
+ right.s+=m;
+ right.ts+=m;
+ right.lcp+=m;
+ right.tl+=m;
+ right.n=p->n-m;
+ if(p->depth>0)
+ 	{left.depth=right.depth=p->depth-1;
+ 	 started=thread_start(&th,lcp_sort,&left);
+ 	}
+ if(!started) lcp_sort(&left);
+ lcp_sort(&right);
+ if(started) thread_join(th);
+ if(p->to_tmp)
+ 	lcp_merge(p->s,p->lcp,m,p->s+m,p->lcp+m,p->n-m,p->ts,p->tl);
+ else
+ 	lcp_merge(p->ts,p->tl,m,p->ts+m,p->tl+m,p->n-m,p->s,p->lcp);
+}
+
+/* lcp_mergesort_threads: lcp_mergesort() using at most nthreads threads (msd_sort() passes 1 when it is already running in one of the threads of msd_radixsort() ) */
+static int lcp_mergesort_threads(char **s,size_t n,int nthreads)
+{struct _lcpsort p;
+ if(n<=1) return 0;
+ p.ts=malloc(n*sizeof(char *));
+ p.lcp=malloc(n*sizeof(lcp_t));
+ p.tl=malloc(n*sizeof(lcp_t));
+ if(p.ts==NULL || p.lcp==NULL || p.tl==NULL)
+ 	{free(p.ts);
+ 	 free(p.lcp);
+ 	 free(p.tl);
+ 	 return -1;
+ 	}
+ p.s=s;
+ p.n=n;
+ p.to_tmp=false;
+ for(p.depth=0;(1<<(p.depth+1))<=nthreads && (n>>(p.depth+1))>=LCP_PAR_MIN;++p.depth); // each level of recursion run in parallel doubles the number of threads
+ lcp_sort(&p);
+ free(p.ts);
+ free(p.lcp);
+ free(p.tl);
+ return 0;
+}
+
+/* lcp_mergesort: sort s[0..n-1] into the same order as strcmp() would give. The sort is stable */
+/* returns 0 if OK, -1 if there is not enough memory (in which case s[] is unchanged) */
+int lcp_mergesort(char **s,size_t n)
+{return lcp_mergesort_threads(s,n,nos_threads());
+}
+
+static inline void swap_str(char **a,char **b)
+{char *t= *a;
+ *a= *b;
+ *b=t;
+}
+
+#define CH(s,d) ((unsigned char)(s)[d]) /* character d of string s, as unsigned so the order is the same as strcmp() */
+
+static char **med3(char **a,char **b,char **c,size_t d) /* return the string with the median character d */
+{int va=CH(*a,d),vb=CH(*b,d),vc=CH(*c,d);
+ if(va==vb) return a;
+ if(vc==va || vc==vb) return c;
+ return va<vb ? (vb<vc ? b : (va<vc ? c : a))
+ 			  : (vb>vc ? b : (va<vc ? a : c));
+}
+
+/* mkqsort: multikey quicksort of s[0..n-1] into strcmp() order, all the strings are known to be the same for their first d characters */
+/* the largest partition is looped on and the others are sorted recursively, so the depth of recursion is at most log2(n) */
+void mkqsort(char **s,size_t n,size_t d)
+{size_t pa,pb,pc,pd,r,nlt,neq,ngt,i,j;
+ int v,c;
+ char *t;
+ while(n>MKQ_INSERT)
+ 	{swap_str(&s[0],med3(&s[0],&s[n/2],&s[n-1],d));
+ 	 v=CH(s[0],d);
+ 	 pa=pb=1;
+ 	 pc=pd=n-1;
+ 	 for(;;) // split into < v , == v and > v (strings equal to v are moved to the ends, then swapped into the middle below)
+ 	 	{while(pb<=pc && (c=CH(s[pb],d)-v)<=0)
+ 	 		{if(c==0) swap_str(&s[pa++],&s[pb]);
+ 	 		 pb++;
+ 	 		}
+ 	 	 while(pb<=pc && (c=CH(s[pc],d)-v)>=0)
+ 	 	 	{if(c==0) swap_str(&s[pc],&s[pd--]);
+ 	 	 	 pc--;
+ 	 	 	}
+ 	 	 if(pb>pc) break;
+ 	 	 swap_str(&s[pb++],&s[pc--]);
+ 	 	}
+ 	 nlt=pb-pa;
+ 	 ngt=pd-pc;
+ 	 neq=n-nlt-ngt;
+ 	 r= pa<nlt ? pa : nlt;
+ 	 for(i=0,j=pb-r;i<r;++i,++j) swap_str(&s[i],&s[j]);
+ 	 r= ngt<n-pd-1 ? ngt : n-pd-1;
+ 	 for(i=pb,j=n-r;i<pb+r;++i,++j) swap_str(&s[i],&s[j]);
+ 	 /* now s[0..nlt-1] < v, s[nlt..nlt+neq-1] == v and s[n-ngt..n-1] > v */
+ 	 if(v==0) neq=0; // strings equal to v have all ended so are identical, no need to sort them
+ 	 if(nlt>=neq && nlt>=ngt)
+ 	 	{mkqsort(s+nlt,neq,d+1);
+ 	 	 mkqsort(s+n-ngt,ngt,d);
+ 	 	 n=nlt;
+ 	 	}
+ 	 else if(neq>=ngt)
+ 	 	{mkqsort(s,nlt,d);
+ 	 	 mkqsort(s+n-ngt,ngt,d);
+ 	 	 s+=nlt;
+ 	 	 n=neq;
+ 	 	 ++d;
+ 	 	}
+ 	 else
+ 	 	{mkqsort(s,nlt,d);
+ 	 	 mkqsort(s+nlt,neq,d+1);
+ 	 	 s+=n-ngt;
+ 	 	 n=ngt;
+ 	 	}
+ 	}
+ for(i=1;i<n;++i) // insertion sort for small n
+ 	{t=s[i];
+ 	 for(j=i;j>0 && strcmp(s[j-1]+d,t+d)>0;--j)
+ 	 	s[j]=s[j-1];
+ 	 s[j]=t;
+ 	}
+}
+
+struct bucket /* strings in one bucket of a trie node */
+	{size_t n,size; // number of strings, and space available
+	 char *s[]; // the strings
+	};
+
+struct trie /* a node of the trie used by burstsort() */
+	{struct trie *child[256]; // child[c] is the node for strings with c as the next character, if bucket c has burst
+	 struct bucket *bucket[256]; // bucket[c] holds strings with c as the next character (bucket[0] holds strings that end here, which are all identical)
+	};
+
+static bool bucket_add(struct bucket **bp,char *str) /* add str to bucket *bp, creating or growing the bucket as required. Returns false if no memory */
+{struct bucket *b= *bp;
+ if(b==NULL || b->n==b->size)
+ 	{size_t size= b==NULL ? 16 : 2*b->size;
+ 	 b=realloc(b,sizeof(struct bucket)+size*sizeof(char *));
+ 	 if(b==NULL) return false; // *bp is unchanged (and still needs to be freed)
+ 	 if(*bp==NULL) b->n=0;
+ 	 b->size=size;
+ 	 *bp=b;
+ 	}
+ b->s[b->n++]=str;
+ return true;
+}
+
+/* burst: replace bucket c of node t by a new node, d is the position in the strings of the character after c. Returns false if no memory */
+static bool burst(struct trie *t,unsigned int c,size_t d)
+{struct bucket *b=t->bucket[c];
+ struct trie *nt=calloc(1,sizeof(struct trie));
+ size_t i;
+ if(nt==NULL) return false;
+ t->child[c]=nt;
+ t->bucket[c]=NULL;
+ for(i=0;i<b->n;++i)
+ 	if(!bucket_add(&nt->bucket[CH(b->s[i],d)],b->s[i]))
+ 		{free(b);
+ 		 return false;
+ 		}
+ free(b);
+ return true;
+}
+
+static void free_trie(struct trie *t)
+{unsigned int c;
+ for(c=0;c<256;++c)
+ 	{if(t->child[c]!=NULL) free_trie(t->child[c]);
+ 	 free(t->bucket[c]);
+ 	}
+ free(t);
+}
+
+/* walk trie t in order putting the strings into s[*k..] and sorting each bucket. All strings under t are the same for their first d characters */
+static void burst_output(struct trie *t,size_t d,char **s,size_t *k)
+{unsigned int c;
+ struct bucket *b;
+ for(c=0;c<256;++c)
+ 	if(t->child[c]!=NULL)
+ 		burst_output(t->child[c],d+1,s,k);
+ 	else if((b=t->bucket[c])!=NULL)
+ 		{memcpy(s+*k,b->s,b->n*sizeof(char *));
+ 		 if(c!=0 && (b->n<=BURST_LIMIT || lcp_mergesort(s+*k,b->n)<0)) // strings ending here (c==0) are identical
+ 		 	mkqsort(s+*k,b->n,d+1);
+ 		 *k+=b->n;
+ 		}
+}
+
+/* burstsort: sort s[0..n-1] into the same order as strcmp() would give. The sort is not stable, but strings that compare equal are identical */
+/* returns 0 if OK, -1 if there is not enough memory (in which case s[] is unchanged) */
+int burstsort(char **s,size_t n)
+{struct trie *root,*t;
+ size_t i,d,k=0;
+ unsigned int c;
+ if(n<=1) return 0;
+ if((root=calloc(1,sizeof(struct trie)))==NULL)
+ 	return -1;
+ for(i=0;i<n;++i)
+ 	{/* insert s[i] into the trie, following the nodes for its first characters */
+ 	 for(t=root,d=0;(c=CH(s[i],d))!=0 && t->child[c]!=NULL;++d)
+ 	 	t=t->child[c];
+ 	 if(!bucket_add(&t->bucket[c],s[i]) || (c!=0 && t->bucket[c]->n>BURST_LIMIT && d<BURST_MAX_DEPTH && !burst(t,c,d+1)))
+ 	 	{free_trie(root);
+ 	 	 return -1;
+ 	 	}
+ 	}
+ burst_output(root,0,s,&k);
+ free_trie(root);
+ return 0;
+}
+
+/* msd_sort: MSD radix sort of s[0..n-1] into strcmp() order, the strings are all the same for their first d characters */
+/* tmp[] is space for n strings and ch[] for n characters (character d of each string is read once into ch[] so the strings are not read again to move them) */
+/* nthreads is the most threads lcp_mergesort() can use for very long common prefixes, 1 when this is run by one of the threads of msd_radixsort() (otherwise there could be nthreads*nthreads threads) */
+static void msd_sort(char **s,char **tmp,unsigned char *ch,size_t n,size_t d,int nthreads)
+{size_t count[256],i,start,k;
+ unsigned int c;
+ for(;;)
+ 	{if(n<=MSD_MKQ)
+ 		{mkqsort(s,n,d);
+ 		 return;
+ 		}
+ 	 if(d>=MSD_MAX_DEPTH)
+ 	 	{if(lcp_mergesort_threads(s,n,nthreads)<0) mkqsort(s,n,d); // very long common prefixes
+ 	 	 return;
+ 	 	}
+ 	 memset(count,0,sizeof(count));
+ 	 for(i=0;i<n;++i)
+ 	 	++count[ch[i]=CH(s[i],d)];
+ 	 c=ch[0];
+ 	 if(count[c]<n) break;
+ 	 if(c==0) return; // all the strings have ended here, so are identical
+ 	 ++d; // all the strings have the same character d, so no need to move them
+ 	}
+ for(c=0,start=0;c<256;++c) // count[c] becomes the start of bucket c
+ 	{k=count[c];
+ 	 count[c]=start;
+ 	 start+=k;
+ 	}
+ for(i=0;i<n;++i) // count[c] becomes the end of bucket c
+ 	tmp[count[ch[i]]++]=s[i];
+ memcpy(s,tmp,n*sizeof(char *));
+ for(c=1,start=count[0];c<256;++c) // bucket 0 holds strings that have ended so are identical
+ 	{msd_sort(s+start,tmp+start,ch+start,count[c]-start,d+1,nthreads);
+ 	 start=count[c];
+ 	}
+}
+
+struct _msdblock /* work for one thread in msd_radixsort() */
+	{char **s,**tmp; // all the strings, and space for a copy of them
+	 unsigned char *ch; // space for one character of each string
+	 size_t from,to; // phases 0 and 1: strings s[from..to-1] are counted and moved by this thread
+	 size_t d; // character being sorted on
+	 size_t count[256]; // phase 0: number of strings in the block with each character, phase 1: where the next one goes in tmp[]
+	 const size_t *bstart; // phase 2: bucket c is tmp[bstart[c]..bstart[c+1]-1]
+	 bool mine[256]; // phase 2: buckets copied back and sorted by this thread
+	 int phase; // 0 = count characters, 1 = move strings into buckets in tmp[], 2 = sort buckets
+	};
+
+static void msd_block(void *arg) /* do one phase of msd_radixsort() for one thread */
+{struct _msdblock *b=arg;
+ size_t i,start,n;
+ unsigned int c;
+ switch(b->phase)
+ 	{case 0:
+ 		memset(b->count,0,sizeof(b->count));
+ 		for(i=b->from;i<b->to;++i)
+ 			++b->count[b->ch[i]=CH(b->s[i],b->d)];
+ 		break;
+ 	 case 1:
+ 	 	for(i=b->from;i<b->to;++i)
+ 	 		b->tmp[b->count[b->ch[i]]++]=b->s[i];
+ 	 	break;
+ 	 default:
+ 	 	for(c=0;c<256;++c)
+ 	 		if(b->mine[c])
+ 	 			{start=b->bstart[c];
+ 	 			 n=b->bstart[c+1]-start;
+ 	 			 memcpy(b->s+start,b->tmp+start,n*sizeof(char *));
+ 	 			 if(c!=0) msd_sort(b->s+start,b->tmp+start,b->ch+start,n,b->d+1,1); // this is already one of the threads
+ 	 			}
+ 	 	break;
+ 	}
+}
+
+static void run_msd_blocks(struct _msdblock *blocks,thread_t *th,bool *started,int nthreads,int phase) /* run one phase of msd_block() for all blocks in parallel */
+{int t;
+ for(t=0;t<nthreads;++t)
+ 	blocks[t].phase=phase;
+ run_blocks(msd_block,blocks,sizeof(struct _msdblock),nthreads,th,started);
+}
+
+/* msd_radixsort: sort s[0..n-1] into the same order as strcmp() would give. The sort is not stable, but strings that compare equal are identical */
+/* the first character that differs is counted and the strings moved into buckets by parallel threads (each with its own counts), then the buckets are shared between the threads */
+/* returns 0 if OK, -1 if there is not enough memory (in which case s[] is unchanged) */
+int msd_radixsort(char **s,size_t n)
+{char **tmp;
+ unsigned char *ch;
+ struct _msdblock *blocks=NULL;
+ thread_t *th=NULL;
+ bool *started=NULL;
+ size_t bstart[257],size,d,k;
+ int nthreads=threads_for(n,MSD_PAR_MIN),t,owner[256];
+ unsigned int c;
+ if(n<=1) return 0;
+ tmp=malloc(n*sizeof(char *));
+ ch=malloc(n);
+ if(nthreads>1)
+ 	{blocks=malloc(nthreads*sizeof(struct _msdblock));
+ 	 th=malloc(nthreads*sizeof(thread_t));
+ 	 started=malloc(nthreads*sizeof(bool));
+ 	}
+ if(tmp==NULL || ch==NULL || (nthreads>1 && (blocks==NULL || th==NULL || started==NULL)))
+ 	{free(tmp);
+ 	 free(ch);
+ 	 free(blocks);
+ 	 free(th);
+ 	 free(started);
+ 	 return -1;
+ 	}
+ if(nthreads==1)
+ 	msd_sort(s,tmp,ch,n,0,nthreads);
+ else
+ 	{for(t=0;t<nthreads;++t)
+ 		{blocks[t].s=s;
+ 		 blocks[t].tmp=tmp;
+ 		 blocks[t].ch=ch;
+ 		 blocks[t].from=n*t/nthreads;
+ 		 blocks[t].to=n*(t+1)/nthreads;
+ 		 blocks[t].bstart=bstart;
+ 		}
+ 	 for(d=0;;++d) // find the first character that is not the same for all the strings
+ 	 	{for(t=0;t<nthreads;++t)
+ 	 		blocks[t].d=d;
+ 	 	 run_msd_blocks(blocks,th,started,nthreads,0);
+ 	 	 c=ch[0];
+ 	 	 for(size=0,t=0;t<nthreads;++t)
+ 	 	 	size+=blocks[t].count[c];
+ 	 	 if(size<n || c==0 || d>=MSD_MAX_DEPTH) break;
+ 	 	}
+ 	 if(size==n)
+ 	 	{if(c!=0) msd_sort(s,tmp,ch,n,d,nthreads); // only for very long common prefixes
+ 	 	}
+ 	 else
+ 	 	{for(c=0,k=0;c<256;++c) // set where each thread puts its strings starting with c
+ 	 		{bstart[c]=k;
+ 	 		 for(t=0;t<nthreads;++t)
+ 	 		 	{size=blocks[t].count[c];
+ 	 		 	 blocks[t].count[c]=k;
+ 	 		 	 k+=size;
+ 	 		 	}
+ 	 		}
+ 	 	 bstart[256]=n;
+ 	 	 run_msd_blocks(blocks,th,started,nthreads,1);
+ 	 	 for(t=0;t<nthreads;++t)
+ 	 	 	memset(blocks[t].mine,0,sizeof(blocks[t].mine));
+ 	 	 share_buckets(bstart+1,256,nthreads,owner); // biggest bucket first, each to the thread with least to do so far
+ 	 	 for(c=0;c<256;++c)
+ 	 	 	blocks[owner[c]].mine[c]=true;
+ 	 	 run_msd_blocks(blocks,th,started,nthreads,2);
+ 	 	}
+ 	}
+ free(tmp);
+ free(ch);
+ free(blocks);
+ free(th);
+ free(started);
+ return 0;
+}
@@ -0,0 +1,16 @@
+/* strsort.h */
+/* sorting of strings that avoids rescanning common prefixes - see strsort.c */
+#ifndef __STRSORT_H
+ #define __STRSORT_H
+ #include <stddef.h> /* for size_t */
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	int lcp_mergesort(char **s,size_t n); // sort s[] into strcmp() order using a LCP merge sort (stable), returns 0 if OK or -1 if no memory
+	int burstsort(char **s,size_t n); // sort s[] into strcmp() order using a burstsort (fast for very large numbers of strings), returns 0 if OK or -1 if no memory
+	int msd_radixsort(char **s,size_t n); // sort s[] into strcmp() order using a MSD radix sort with parallel threads, returns 0 if OK or -1 if no memory
+	void mkqsort(char **s,size_t n,size_t d); // multikey quicksort of s[] into strcmp() order, the strings must all be the same for their first d characters
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
@@ -0,0 +1,354 @@
+/* threads.c
+   =========
+   portable (Windows and posix) way to run functions in parallel threads.
+   On Windows this uses _beginthreadex() (as qsort.c does), otherwise posix threads are used (so compile with -pthread).
+   nos_threads() and memory_limit() size the work to the resources this process can actually use: in a container the host may have many more processors and much more memory
+   than the container is allowed, so on Linux they also read the processor affinity mask and the cgroup (v2, or v1) limits cpu.max and memory.max of this process.
+   Using more threads than the cpu quota allows just makes the threads wait for each other, and using more memory than memory.max gets the process killed.
+   The user can also limit the threads (nsort -j N, set_max_threads() ) and pin the process to a list of processors (nsort --cpus LIST, set_cpus() ), eg when nsort shares a machine
+   with services that need their own processors. Threads (and worker processes) started after set_cpus() inherit its affinity mask, and nos_threads() then counts just those processors.
+   threads_for() gives fewer threads for small inputs, so every parallel step (key extraction, the sorts, writing split files) uses the same rule.
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#ifdef __linux__
+ #define _GNU_SOURCE /* for sched_getaffinity(), sched_setaffinity() and pthread_tryjoin_np() */
+ #include <sched.h>
+#endif
+#ifndef _WIN32
+ #define _POSIX_C_SOURCE 200809L /* for sysconf() with -std=c99 */
+ #include <unistd.h> /* for sysconf() */
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads.h"
+#ifdef _WIN32
+ #include <process.h> /* for _beginthreadex */
+#endif
+
+struct _thread_params /* passed to the new thread, which frees it */
+	{void (*func)(void *);
+	 void *arg;
+	};
+
+#ifdef _WIN32
+static unsigned __stdcall thread_func(void *_Arg)
+{struct _thread_params p= *(struct _thread_params *)_Arg;
+ free(_Arg);
+ p.func(p.arg);
+ _endthreadex(0);
+ return 0;
+}
+#else
+static void *thread_func(void *_Arg)
+{struct _thread_params p= *(struct _thread_params *)_Arg;
+ free(_Arg);
+ p.func(p.arg);
+ return NULL;
+}
+#endif
+
+/* start func(arg) running in a new thread, returns false if the thread could not be started (in which case the caller should just call func(arg) itself) */
+bool thread_start(thread_t *th,void (*func)(void *),void *arg)
+{struct _thread_params *p=malloc(sizeof(struct _thread_params));
+ if(p==NULL) return false;
+ p->func=func;
+ p->arg=arg;
+#ifdef _WIN32
+ *th=(HANDLE)_beginthreadex(NULL,0,thread_func,p,0,NULL);
+ if(*th==NULL)
+#else
+ if(pthread_create(th,NULL,thread_func,p)!=0)
+#endif
+ 	{free(p);
+ 	 return false;
+ 	}
+ return true;
+}
+
+/* wait for thread th (started by thread_start() ) to finish */
+void thread_join(thread_t th)
+{
+#ifdef _WIN32
+ WaitForSingleObject(th,INFINITE);
+ CloseHandle(th);// Destroy the thread object.
+#else
+ pthread_join(th,NULL);
+#endif
+}
+
+/* returns true if thread th (started by thread_start() ) has finished, in which case it has been joined (so thread_join() must not be called for it), otherwise returns false without waiting */
+/* on posix systems other than Linux this always returns false, so the caller has to wait for the thread with thread_join() */
+bool thread_try_join(thread_t th)
+{
+#ifdef _WIN32
+ if(WaitForSingleObject(th,0)==WAIT_TIMEOUT) return false;
+ CloseHandle(th);// Destroy the thread object.
+ return true;
+#elif defined __linux__
+ return pthread_tryjoin_np(th,NULL)==0;
+#else
+ (void)th;
+ return false;
+#endif
+}
+
+/* run_blocks: run func() on each of the n blocks (each size bytes, in an array starting at blocks) in parallel and wait for them all to finish */
+/* the last block (and any block whose thread could not be started) is done by this thread. th[] and started[] need space for n entries */
+void run_blocks(void (*func)(void *),void *blocks,size_t size,int n,thread_t *th,bool *started)
+{int t;
+ for(t=0;t<n;++t)
+ 	{void *b=(char *)blocks+(size_t)t*size;
+ 	 started[t]= t+1<n && thread_start(&th[t],func,b);
+ 	 if(!started[t])
+ 	 	func(b);
+ 	}
+ for(t=0;t<n;++t)
+ 	if(started[t])
+ 		thread_join(th[t]);
+}
+
+/* share_buckets: share nbuckets buckets between nthreads threads, setting owner[c] to the thread that does bucket c */
+/* bucket c holds items end[c-1] to end[c]-1 (0 to end[0]-1 for bucket 0). The biggest bucket goes first, each to the thread with the fewest items so far, so the threads finish at about the same time */
+void share_buckets(const size_t *end,unsigned int nbuckets,int nthreads,int *owner)
+{size_t *load=calloc(nthreads,sizeof(size_t)),best,size;
+ unsigned int c,cbest;
+ int t,tmin;
+ if(load==NULL)
+ 	{for(c=0;c<nbuckets;++c)
+ 		owner[c]=c%nthreads; // not enough memory, so just take turns
+ 	 return;
+ 	}
+ for(c=0;c<nbuckets;++c)
+ 	owner[c]= -1;
+ for(;;)
+ 	{for(c=0,best=0,cbest=nbuckets;c<nbuckets;++c)
+ 		{size=end[c]-(c==0 ? 0 : end[c-1]);
+ 		 if(owner[c]<0 && size>=best)
+ 		 	{best=size;
+ 		 	 cbest=c;
+ 		 	}
+ 		}
+ 	 if(cbest==nbuckets) break;
+ 	 for(tmin=0,t=1;t<nthreads;++t)
+ 	 	if(load[t]<load[tmin]) tmin=t;
+ 	 owner[cbest]=tmin;
+ 	 load[tmin]+=best;
+ 	}
+ free(load);
+}
+
+#ifdef __linux__
+#define CGROUP_ROOT "/sys/fs/cgroup"
+#define CGROUP_PATH_MAX 4096
+
+static bool read_line(const char *name,char *line,int size) /* read the first line of file name, returns false if it cannot be read */
+{FILE *fp=fopen(name,"r");
+ bool ok;
+ if(fp==NULL) return false;
+ ok= fgets(line,size,fp)!=NULL;
+ fclose(fp);
+ return ok;
+}
+
+/* cgroup_limit: return the smallest limit in file (eg "memory.max") for the cgroup v2 of this process and all the cgroups above it, as worked out by value() from the first line of the file */
+/* value() returns 0 if the file says there is no limit ("max"). Returns 0 if there is no limit (or cgroups v2 are not used) */
+static uint64_t cgroup_limit(const char *file,uint64_t (*value)(const char *line))
+{char path[CGROUP_PATH_MAX],line[256],*p;
+ uint64_t v,limit=0;
+ FILE *fp=fopen("/proc/self/cgroup","r");
+ size_t len=strlen(CGROUP_ROOT);
+ strcpy(path,CGROUP_ROOT);
+ if(fp!=NULL)
+ 	{while(fgets(path+len,sizeof(path)-len,fp)!=NULL) // cgroup v2 is the line "0::/path"
+ 		if(strncmp(path+len,"0::",3)==0)
+ 			{memmove(path+len,path+len+3,strlen(path+len+3)+1);
+ 			 if((p=strchr(path+len,'\n'))!=NULL) *p='\0';
+ 			 break;
+ 			}
+ 		else
+ 			path[len]='\0';
+ 	 fclose(fp);
+ 	}
+ while(1) // this cgroup and all the ones above it (in a container the cgroup is usually "/" so this is just CGROUP_ROOT)
+ 	{len=strlen(path);
+ 	 if(len>0 && path[len-1]=='/') path[--len]='\0';
+ 	 if(len+strlen(file)+2<sizeof(path))
+ 	 	{sprintf(path+len,"/%s",file);
+ 	 	 if(read_line(path,line,sizeof(line)) && (v=value(line))>0 && (limit==0 || v<limit))
+ 	 	 	limit=v;
+ 	 	 path[len]='\0';
+ 	 	}
+ 	 if(len<=strlen(CGROUP_ROOT) || (p=strrchr(path,'/'))==NULL) break;
+ 	 *p='\0';
+ 	}
+ return limit;
+}
+
+static uint64_t cpu_max_value(const char *line) /* cpu.max is "quota period" in microseconds or "max period", returns the quota as a number of processors (rounded up) */
+{unsigned long long quota,period;
+ if(sscanf(line,"%llu %llu",&quota,&period)!=2 || period==0) return 0; // "max" means no limit
+ return (quota+period-1)/period;
+}
+
+static uint64_t memory_max_value(const char *line) /* memory.max is a number of bytes or "max" */
+{unsigned long long bytes;
+ if(sscanf(line,"%llu",&bytes)!=1) return 0;
+ return bytes;
+}
+
+static uint64_t cgroup_v1_value(const char *name) /* value of a cgroup v1 file (eg memory.limit_in_bytes), 0 if not present */
+{char line[256];
+ long long v;
+ if(!read_line(name,line,sizeof(line)) || sscanf(line,"%lld",&v)!=1 || v<=0) return 0; // a quota of -1 means no limit
+ return (uint64_t)v;
+}
+#endif
+
+static int saved_threads=0; /* result of nos_threads(), 0 if it needs to be worked out again */
+static int max_threads=0; /* limit set by set_max_threads(), 0 for no limit */
+
+/* set_max_threads: limit nos_threads() to n (nsort -j N), 0 means no limit */
+void set_max_threads(int n)
+{max_threads= n>0 ? n : 0;
+ saved_threads=0;
+}
+
+/* set_cpus: restrict this process to the logical processors in list, eg "0-3,8,10-11" (nsort --cpus LIST). Threads started after this can only run on these processors */
+/* returns false if list is not valid or the affinity could not be set (eg a processor in list does not exist or is not allowed by the container) */
+bool set_cpus(const char *list)
+{const char *p=list;
+ char *end;
+ unsigned long from,to,c;
+#ifdef _WIN32
+ DWORD_PTR mask=0;
+ const unsigned long max_cpus=sizeof(DWORD_PTR)*8;
+#elif defined __linux__
+ cpu_set_t set;
+ const unsigned long max_cpus=CPU_SETSIZE;
+ CPU_ZERO(&set);
+#else
+ const unsigned long max_cpus=0; // no portable way to set the affinity
+#endif
+ do
+ 	{if(*p<'0' || *p>'9') return false;
+ 	 from=to=strtoul(p,&end,10);
+ 	 p=end;
+ 	 if(*p=='-')
+ 	 	{++p;
+ 	 	 if(*p<'0' || *p>'9') return false;
+ 	 	 to=strtoul(p,&end,10);
+ 	 	 p=end;
+ 	 	}
+ 	 if(to<from || to>=max_cpus) return false;
+ 	 for(c=from;c<=to;++c)
+ 		{
+#ifdef _WIN32
+ 		 mask|=(DWORD_PTR)1<<c;
+#elif defined __linux__
+ 		 CPU_SET(c,&set);
+#endif
+ 		}
+ 	} while(*p++==',');
+ if(p[-1]!='\0') return false; // something other than a number, range or comma
+ saved_threads=0; // nos_threads() now counts just these processors
+#ifdef _WIN32
+ return SetProcessAffinityMask(GetCurrentProcess(),mask)!=0;
+#elif defined __linux__
+ return sched_setaffinity(0,sizeof(set),&set)==0;
+#else
+ return false;
+#endif
+}
+
+/* return the number of threads worth running in parallel, which is the number of logical processors this process can use (always >=1) */
+/* on Linux this is the smallest of the processors online, the processors in the affinity mask (eg set by taskset, docker --cpuset-cpus or set_cpus() ) and the cgroup cpu quota (eg docker --cpus or a Kubernetes cpu limit) */
+/* this is also limited by set_max_threads(). The result is worked out once then saved, as this is called for every parallel step */
+int nos_threads(void)
+{int n;
+ if(saved_threads>0) return saved_threads;
+#ifdef _WIN32
+ {SYSTEM_INFO si;
+  DWORD_PTR process_mask,system_mask;
+  GetSystemInfo(&si);
+  n=(int)si.dwNumberOfProcessors;
+  if(GetProcessAffinityMask(GetCurrentProcess(),&process_mask,&system_mask))
+  	{int c=0;
+  	 for(;process_mask!=0;process_mask&=process_mask-1) ++c; // count the bits set
+  	 if(c>0 && c<n) n=c;
+  	}
+ }
+#else
+ n=(int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+#ifdef __linux__
+ {cpu_set_t set;
+  uint64_t quota,period;
+  if(sched_getaffinity(0,sizeof(set),&set)==0 && CPU_COUNT(&set)>0 && CPU_COUNT(&set)<n)
+  	n=CPU_COUNT(&set);
+  if((quota=cgroup_limit("cpu.max",cpu_max_value))>0 && quota<(uint64_t)n)
+  	n=(int)quota;
+  if((quota=cgroup_v1_value(CGROUP_ROOT "/cpu/cpu.cfs_quota_us"))>0 && (period=cgroup_v1_value(CGROUP_ROOT "/cpu/cpu.cfs_period_us"))>0 && (quota+period-1)/period<(uint64_t)n)
+  	n=(int)((quota+period-1)/period);
+ }
+#endif
+ if(max_threads>0 && max_threads<n) n=max_threads;
+ saved_threads= n<1 ? 1 : n;
+ return saved_threads;
+}
+
+/* threads_for: number of threads to use for n items when each thread needs at least min_per_thread items to be worth starting (always >=1 and at most nos_threads() ) */
+int threads_for(size_t n,size_t min_per_thread)
+{int nthreads=nos_threads();
+ if(min_per_thread>0 && (size_t)nthreads>n/min_per_thread) nthreads=(int)(n/min_per_thread);
+ return nthreads<1 ? 1 : nthreads;
+}
+
+/* return the number of bytes of memory this process can use, 0 if not known */
+/* this is the physical memory, or on Linux the cgroup memory limit if that is less (eg docker --memory or a Kubernetes memory limit) */
+uint64_t memory_limit(void)
+{uint64_t limit=0;
+#ifdef _WIN32
+ MEMORYSTATUSEX ms;
+ ms.dwLength=sizeof(ms);
+ if(GlobalMemoryStatusEx(&ms))
+ 	limit=(uint64_t)ms.ullTotalPhys;
+#else
+ long pages=sysconf(_SC_PHYS_PAGES),page_size=sysconf(_SC_PAGESIZE);
+ if(pages>0 && page_size>0)
+ 	limit=(uint64_t)pages*(uint64_t)page_size;
+#endif
+#ifdef __linux__
+ {uint64_t v;
+  if((v=cgroup_limit("memory.max",memory_max_value))>0 && (limit==0 || v<limit))
+  	limit=v;
+  if((v=cgroup_v1_value(CGROUP_ROOT "/memory/memory.limit_in_bytes"))>0 && (limit==0 || v<limit)) // when there is no limit this is a huge number, so the physical memory is less
+  	limit=v;
+ }
+#endif
+ return limit;
+}
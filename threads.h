@@ -0,0 +1,31 @@
+/* threads.h */
+/* portable (Windows and posix) way to run functions in parallel threads - see threads.c */
+#ifndef __THREADS_H
+ #define __THREADS_H
+ #include <stdbool.h> /* for bool */
+ #include <stdint.h> /* for uint64_t */
+ #include <stddef.h> /* for size_t */
+ #ifdef _WIN32
+  #include <windows.h> /* for HANDLE */
+  typedef HANDLE thread_t;
+ #else
+  #include <pthread.h>
+  typedef pthread_t thread_t;
+ #endif
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	bool thread_start(thread_t *th,void (*func)(void *),void *arg); // start func(arg) running in a new thread, returns false if the thread could not be started
+	void thread_join(thread_t th); // wait for thread th to finish
+	bool thread_try_join(thread_t th); // returns true if thread th has finished (and joins it), false if it is still running (or this cannot be checked without waiting)
+	void run_blocks(void (*func)(void *),void *blocks,size_t size,int n,thread_t *th,bool *started); // run func() on each of the n blocks of size bytes in parallel threads, and wait for them all to finish
+	void share_buckets(const size_t *end,unsigned int nbuckets,int nthreads,int *owner); // set owner[c] to the thread that does bucket c (items end[c-1]..end[c]-1), biggest first to the least loaded thread
+	int nos_threads(void); // number of threads worth running in parallel (the number of logical processors this process can use, allowing for affinity and container cpu limits)
+	int threads_for(size_t n,size_t min_per_thread); // nos_threads(), but fewer for small n so each thread gets at least min_per_thread items
+	void set_max_threads(int n); // limit nos_threads() to n (0 for no limit)
+	bool set_cpus(const char *list); // only run on the logical processors in list (eg "0-3,8"), returns false if list is not valid or cannot be set
+	uint64_t memory_limit(void); // bytes of memory this process can use (physical memory, or less if limited by a container), 0 if not known
+ #ifdef __cplusplus
+    }
+ #endif
+#endif
@@ -0,0 +1,190 @@
+/* workers.c
+   =========
+   portable (Windows and posix) way to run copies of this program as worker processes, with a pipe to each workers stdin and one from its stdout.
+   This is used by nsort --workers N, where each worker sorts a range of the keys (see nsort.c).
+   On Windows this uses CreateProcess(), otherwise fork() and exec().
+   The program run is this program (found using GetModuleFileName() on Windows or /proc/self/exe on Linux), or argv[0] if that cannot be found.
+
+   This version (c) Peter Miller 2022.
+*/
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022 Peter Miller
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHOR OR COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *--------------------------------------------------------------------------*/
+#ifndef _WIN32
+ #define _POSIX_C_SOURCE 200809L /* for fork(), fdopen() etc with -std=c99 */
+ #include <unistd.h> /* for fork(), pipe(), dup2(), exec() */
+ #include <fcntl.h> /* for fcntl() */
+ #include <sys/wait.h> /* for waitpid() */
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "workers.h"
+#ifdef _WIN32
+ #include <io.h> /* for _open_osfhandle() */
+ #include <fcntl.h> /* for _O_TEXT */
+#endif
+
+#ifdef _WIN32
+static char *command_line(const char *exe,char *const argv[]) /* argv[1..] as a Windows command line (each argument in double quotes) for the program exe, returns NULL if no memory */
+{size_t len=strlen(exe)+3,nbs;
+ int i;
+ const char *s;
+ char *cmd,*p;
+ for(i=1;argv[i]!=NULL;++i)
+ 	len+=2*strlen(argv[i])+3; // worst case every character needs a \ before it
+ if((cmd=malloc(len+1))==NULL) return NULL;
+ p=cmd;
+ p+=sprintf(p,"\"%s\"",exe);
+ for(i=1;argv[i]!=NULL;++i)
+ 	{*p++=' ';
+ 	 *p++='"';
+ 	 for(s=argv[i];;++s)
+ 	 	{for(nbs=0;*s=='\\';++s) ++nbs; // backslashes are only special before a " (including the one that ends the argument), where they must be doubled
+ 	 	 if(*s=='"' || *s=='\0') nbs*=2;
+ 	 	 while(nbs-->0) *p++='\\';
+ 	 	 if(*s=='\0') break;
+ 	 	 if(*s=='"') *p++='\\';
+ 	 	 *p++=*s;
+ 	 	}
+ 	 *p++='"';
+ 	}
+ *p='\0';
+ return cmd;
+}
+
+bool worker_start(struct worker *w,char *const argv[])
+{SECURITY_ATTRIBUTES sa;
+ STARTUPINFOA si;
+ PROCESS_INFORMATION pi;
+ HANDLE in_r,in_w,out_r,out_w;
+ char exe[MAX_PATH];
+ char *cmd;
+ DWORD len;
+ BOOL ok;
+ sa.nLength=sizeof(sa);
+ sa.lpSecurityDescriptor=NULL;
+ sa.bInheritHandle=TRUE;
+ if(!CreatePipe(&in_r,&in_w,&sa,0)) return false;
+ if(!CreatePipe(&out_r,&out_w,&sa,0))
+ 	{CloseHandle(in_r);
+ 	 CloseHandle(in_w);
+ 	 return false;
+ 	}
+ SetHandleInformation(in_w,HANDLE_FLAG_INHERIT,0); // our ends of the pipes must not be inherited, otherwise the worker would never see the end of its input
+ SetHandleInformation(out_r,HANDLE_FLAG_INHERIT,0);
+ len=GetModuleFileNameA(NULL,exe,sizeof(exe));
+ if(len==0 || len>=sizeof(exe))
+ 	{strncpy(exe,argv[0],sizeof(exe)-1);
+ 	 exe[sizeof(exe)-1]='\0';
+ 	}
+ cmd=command_line(exe,argv);
+ memset(&si,0,sizeof(si));
+ si.cb=sizeof(si);
+ si.dwFlags=STARTF_USESTDHANDLES;
+ si.hStdInput=in_r;
+ si.hStdOutput=out_w;
+ si.hStdError=GetStdHandle(STD_ERROR_HANDLE);
+ ok= cmd!=NULL && CreateProcessA(exe,cmd,NULL,NULL,TRUE,0,NULL,NULL,&si,&pi);
+ free(cmd);
+ CloseHandle(in_r); // the worker has its own copies of these
+ CloseHandle(out_w);
+ if(!ok)
+ 	{CloseHandle(in_w);
+ 	 CloseHandle(out_r);
+ 	 return false;
+ 	}
+ CloseHandle(pi.hThread);
+ w->process=pi.hProcess;
+ w->in=_fdopen(_open_osfhandle((intptr_t)in_w,_O_TEXT),"w");
+ w->out=_fdopen(_open_osfhandle((intptr_t)out_r,_O_TEXT|_O_RDONLY),"r");
+ if(w->in==NULL || w->out==NULL)
+ 	{if(w->in!=NULL) fclose(w->in);
+ 	 worker_wait(w);
+ 	 return false;
+ 	}
+ return true;
+}
+
+int worker_wait(struct worker *w)
+{DWORD status;
+ if(w->out!=NULL) fclose(w->out);
+ w->out=NULL;
+ WaitForSingleObject(w->process,INFINITE);
+ if(!GetExitCodeProcess(w->process,&status)) status=(DWORD)-1;
+ CloseHandle(w->process);
+ return (int)status;
+}
+
+#else
+
+bool worker_start(struct worker *w,char *const argv[])
+{int to[2],from[2]; // pipes to the workers stdin and from its stdout, [0] is the end to read from and [1] the end to write to
+ pid_t pid;
+ if(pipe(to)!=0) return false;
+ if(pipe(from)!=0)
+ 	{close(to[0]);
+ 	 close(to[1]);
+ 	 return false;
+ 	}
+ fcntl(to[1],F_SETFD,FD_CLOEXEC); // our ends of the pipes must be closed in all the workers, otherwise a worker would never see the end of its input
+ fcntl(from[0],F_SETFD,FD_CLOEXEC);
+ if((pid=fork())<0)
+ 	{close(to[0]);
+ 	 close(to[1]);
+ 	 close(from[0]);
+ 	 close(from[1]);
+ 	 return false;
+ 	}
+ if(pid==0)
+ 	{// the worker
+ 	 dup2(to[0],0);
+ 	 dup2(from[1],1);
+ 	 close(to[0]);
+ 	 close(from[1]);
+ 	 execv("/proc/self/exe",argv);
+ 	 execvp(argv[0],argv); // no /proc (not Linux)
+ 	 _exit(127);
+ 	}
+ close(to[0]);
+ close(from[1]);
+ w->process=pid;
+ w->in=fdopen(to[1],"w");
+ w->out=fdopen(from[0],"r");
+ if(w->in==NULL || w->out==NULL)
+ 	{if(w->in!=NULL) fclose(w->in);
+ 	 else close(to[1]);
+ 	 if(w->out==NULL) close(from[0]);
+ 	 worker_wait(w);
+ 	 return false;
+ 	}
+ return true;
+}
+
+int worker_wait(struct worker *w)
+{int status;
+ if(w->out!=NULL) fclose(w->out);
+ w->out=NULL;
+ if(waitpid(w->process,&status,0)!=w->process || !WIFEXITED(status)) return -1;
+ return WEXITSTATUS(status);
+}
+#endif
@@ -0,0 +1,28 @@
+/* workers.h */
+/* portable (Windows and posix) way to run copies of this program as worker processes connected by pipes - see workers.c */
+#ifndef __WORKERS_H
+ #define __WORKERS_H
+ #include <stdio.h> /* for FILE */
+ #include <stdbool.h> /* for bool */
+ #ifdef _WIN32
+  #include <windows.h> /* for HANDLE */
+  typedef HANDLE process_t;
+ #else
+  #include <sys/types.h> /* for pid_t */
+  typedef pid_t process_t;
+ #endif
+ #ifdef __cplusplus
+  extern "C" {
+ #endif
+	struct worker
+		{FILE *in; // the workers stdin, fclose() this once all its input has been written
+		 FILE *out; // the workers stdout
+		 process_t process;
+		};
+
+	bool worker_start(struct worker *w,char *const argv[]); // start this program running with arguments argv[1..] (argv[] ends with NULL) as a worker process, returns false if it could not be started
+	int worker_wait(struct worker *w); // fclose() w->out then wait for the worker to finish, returns its exit status (or -1 if that is not known)
+ #ifdef __cplusplus
+    }
+ #endif
+#endif